@@ -0,0 +1,225 @@
+/* Name: appinterface.h
+ * Project: USBaspLoader
+ * Creation Date: 2026-10-18
+ * License: GNU GPL v2 (see License.txt)
+ */
+
+#ifndef APPINTERFACE_H_3c1f0e52d6a94b1b9c8e2f4a7d615b20
+#define APPINTERFACE_H_3c1f0e52d6a94b1b9c8e2f4a7d615b20
+
+/*
+ * appinterface.h describes data structures stored in flash (or RAM) which
+ * are shared between the bootloader, the application firmware and host
+ * tools. Only plain integer types are used, all values are little endian
+ * (as AVR is) and structures are packed - so host tools can include this
+ * file, too.
+ */
+
+#include <stdint.h>
+
+/* ------------------------------------------------------------------------ */
+/*                        application slots (A/B)                           */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Flash layout with "HAVE_APPSLOTS":
+ *
+ *   0x00000			trampoline page (owned by bootloader):
+ *				one "jmp" per interrupt vector into the active slot
+ *   APPSLOT_BASE(0)		slot 0 (A): image, linked to this address
+ *   APPSLOT_HEADER(0)		          : last page, appslotheader_t
+ *   APPSLOT_BASE(1)		slot 1 (B): image, linked to this address
+ *   APPSLOT_HEADER(1)		          : last page, appslotheader_t
+ *   BOOTLOADER_PAGEADDR	bootloader
+ *
+ * Images are linked for their slot (e.g. "-Wl,--section-start=.text=0x100").
+ * Of both slots with a valid header, the one with the higher "sequence"
+ * (in 16bit serial number arithmetic) is active. The bootloader keeps the
+ * trampoline page pointing to the active slot.
+ */
+
+#define APPSLOT_MAGIC		0x5a51
+
+/* slot geometry: "blspageaddr" is the first page of the bootloader section */
+#define APPSLOT_SIZE_EX(blspageaddr, pagesize)		(((((blspageaddr) - (pagesize)) / 2) / (pagesize)) * (pagesize))
+#define APPSLOT_BASE_EX(slot, blspageaddr, pagesize)	((pagesize) + ((slot) ? APPSLOT_SIZE_EX(blspageaddr, pagesize) : 0))
+#define APPSLOT_HEADER_EX(slot, blspageaddr, pagesize)	(APPSLOT_BASE_EX(slot, blspageaddr, pagesize) + APPSLOT_SIZE_EX(blspageaddr, pagesize) - (pagesize))
+
+typedef struct __attribute__((packed)) appslotheader {
+    uint16_t	magic;		/* APPSLOT_MAGIC */
+    uint16_t	sequence;	/* valid slot with higher sequence is active */
+    uint16_t	version;	/* free for use by the host */
+    uint16_t	crc;		/* _crc16_update() (init 0xffff) over image */
+    uint32_t	length;		/* image length in bytes */
+    uint16_t	hdrcrc;		/* _crc16_update() (init 0xffff) over all bytes above */
+} appslotheader_t;
+
+/* OUT data of "commit": the bootloader verifies the image and writes the header */
+typedef struct __attribute__((packed)) appslotcommit {
+    uint16_t	version;
+    uint16_t	crc;
+    uint32_t	length;
+} appslotcommit_t;
+
+/* IN data of "slot info" */
+typedef struct __attribute__((packed)) appslotinfo {
+    uint8_t		slot;		/* slot described */
+    uint8_t		active;		/* active slot or 0xff if none */
+    uint16_t		pages;		/* slot size in pages (including header page) */
+    uint32_t		base;		/* slot flash byte address */
+    appslotheader_t	header;		/* raw header as stored in flash */
+} appslotinfo_t;
+
+#define APPSLOT_NONE		0xff
+
+/* ------------------------------------------------------------------------ */
+/*                          application manifest                            */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * With "HAVE_APPMANIFEST" the last page of the application area (the page
+ * right below BOOTLOADER_PAGEADDR) may hold an appmanifest_t describing
+ * the flash actually used by the application (see "tools/mkmanifest").
+ * The image consists of 1 to APPMANIFEST_MAXSEGMENTS segments with page
+ * aligned start addresses in ascending order - a contiguous image is a
+ * single segment starting at 0. "crc" covers all segment bytes in
+ * ascending address order, the manifest page is never part of the image.
+ */
+
+#define APPMANIFEST_MAGIC		0x4d41
+#define APPMANIFEST_VERSION		1
+#define APPMANIFEST_MAXSEGMENTS		4
+
+#define APPMANIFEST_ADDR_EX(blspageaddr, pagesize)	((blspageaddr) - (pagesize))
+
+typedef struct __attribute__((packed)) appmanifestsegment {
+    uint32_t	start;		/* flash byte address */
+    uint32_t	length;		/* bytes */
+} appmanifestsegment_t;
+
+typedef struct __attribute__((packed)) appmanifest {
+    uint16_t		magic;		/* APPMANIFEST_MAGIC */
+    uint8_t		version;	/* APPMANIFEST_VERSION */
+    uint8_t		segments;	/* number of valid entries in "segment" */
+    uint32_t		length;		/* image length in bytes (sum of all segments) */
+    uint16_t		pages;		/* flash pages occupied by the image */
+    uint16_t		crc;		/* _crc16_update() (init 0xffff) over image */
+    appmanifestsegment_t	segment[APPMANIFEST_MAXSEGMENTS];
+    uint16_t		mancrc;		/* _crc16_update() (init 0xffff) over all bytes above */
+} appmanifest_t;
+
+/* IN data of "image crc" */
+typedef struct __attribute__((packed)) appimagecrc {
+    uint8_t		manifest;	/* 0: no valid manifest (whole area), 1: crc matches manifest, 2: mismatch */
+    uint16_t		crc;		/* _crc16_update() (init 0xffff) over image (or whole area) */
+    uint32_t		length;		/* number of bytes covered by "crc" */
+} appimagecrc_t;
+
+/* ------------------------------------------------------------------------ */
+/*                            USB handoff                                   */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * With "HAVE_USBHANDOFF" a firmware entering the bootloader by software
+ * (boot address stored at RAMEND, then watchdog reset) may store this
+ * mailbox directly below the boot address to skip USB re-enumeration.
+ * "deviceaddr" is the plain 7 bit USB address (0..127) as sent by the host
+ * in SET_ADDRESS - that is the firmware's "usbNewDeviceAddr", NOT V-USB's
+ * "usbDeviceAddr", which holds the address already shifted left by one.
+ * "check" is the complement of (magic ^ deviceaddr ^ configuration).
+ */
+
+#define APPUSBHANDOFF_MAGIC		0xa7
+
+/* RAM address of the mailbox: boot address takes 3 bytes on MCUs > 128k flash */
+#define APPUSBHANDOFF_ADDR_EX(ramend, flashend)	((ramend) - (((flashend) > 131071) ? 3 : 2) - sizeof(appusbhandoff_t) + 1)
+
+typedef struct __attribute__((packed)) appusbhandoff {
+    uint8_t	magic;		/* APPUSBHANDOFF_MAGIC */
+    uint8_t	deviceaddr;	/* 7 bit address: "usbNewDeviceAddr" of the firmware's V-USB */
+    uint8_t	configuration;	/* "usbConfiguration" of the firmware's V-USB */
+    uint8_t	check;
+} appusbhandoff_t;
+
+/* ------------------------------------------------------------------------ */
+/*                            staged update                                 */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Flash layout with "HAVE_STAGEDUPDATE":
+ *
+ *   0x00000			running application
+ *   APPSTAGE_BASE		staging area: the application downloads the new
+ *				image here (via "bootloader__do_spm")
+ *   APPSTAGE_DESCRIPTOR	last page below the bootloader: appstage_t,
+ *				written by the application after the image
+ *   BOOTLOADER_PAGEADDR	bootloader
+ *
+ * The application must not be larger than APPSTAGE_BASE. At the next reset
+ * the bootloader checks descriptor and image CRC, copies all changed pages
+ * of the image to address 0 and erases the descriptor page when the copy
+ * verifies. An interrupted copy simply is repeated at the next reset.
+ */
+
+#define APPSTAGE_MAGIC			0x5354
+
+#define APPSTAGE_DESCRIPTOR_EX(blspageaddr, pagesize)	((blspageaddr) - (pagesize))
+#define APPSTAGE_BASE_EX(blspageaddr, pagesize)		(((((blspageaddr) - (pagesize)) / (pagesize)) / 2) * (pagesize))
+
+typedef struct __attribute__((packed)) appstage {
+    uint16_t	magic;		/* APPSTAGE_MAGIC */
+    uint16_t	crc;		/* _crc16_update() (init 0xffff) over staged image */
+    uint32_t	length;		/* image length in bytes (at most APPSTAGE_BASE) */
+    uint16_t	desccrc;	/* _crc16_update() (init 0xffff) over all bytes above */
+} appstage_t;
+
+/* ------------------------------------------------------------------------ */
+/*                          image authentication                            */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * With "HAVE_IMAGEAUTH" the image is the flash content from address 0 up to
+ * "length" (even, gaps filled with 0xff). It has to be written in ascending
+ * order without skipping any page, right after announcing length and MAC.
+ * The last page may be padded with 0xff behind "length" (as avrdude does),
+ * the padding is not part of the MAC; any other data behind it fails.
+ * MAC: XTEA (32 cycles, 128bit key given as four little endian words) in
+ * CBC mode with zero IV over
+ *
+ *   appimageauthprefix_t, image, 0xff padding to a multiple of 8 bytes
+ *
+ * where each 8 byte block is read as two little endian 32bit words. The MAC
+ * is the final chaining value (again as two little endian words).
+ */
+
+#define APPIMAGEAUTH_MAGIC		0x48545541	/* "AUTH" */
+#define APPIMAGEAUTH_VALID		0x5a		/* EEPROM flag value of an authenticated image */
+
+typedef struct __attribute__((packed)) appimageauthprefix {
+    uint32_t	length;		/* image length in bytes */
+    uint32_t	magic;		/* APPIMAGEAUTH_MAGIC */
+} appimageauthprefix_t;
+
+/* ------------------------------------------------------------------------ */
+/*                              flash wear log                              */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * With "HAVE_WEARLOG" the EEPROM holds "entries" little endian 16bit erase
+ * counters starting at "eeaddr". Counter i covers the application pages
+ * (i << pageshift) up to ((i + 1) << pageshift) - 1, every erase of one of
+ * them counts once. APPWEARLOG_UNUSED means no erase has been counted yet,
+ * counters stop at APPWEARLOG_MAX.
+ */
+
+#define APPWEARLOG_UNUSED		0xffff
+#define APPWEARLOG_MAX			0xfffe
+
+/* IN data of "wear log info" */
+typedef struct __attribute__((packed)) appwearloginfo {
+    uint16_t	eeaddr;		/* EEPROM address of the counter table */
+    uint16_t	entries;	/* number of counters */
+    uint8_t	pageshift;	/* log2 of the pages per counter */
+} appwearloginfo_t;
+
+#endif /* APPINTERFACE_H_3c1f0e52d6a94b1b9c8e2f4a7d615b20 */
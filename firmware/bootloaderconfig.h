@@ -326,6 +326,24 @@ these macros are defined, the boot loader usees them.
  * 
  */
 
+#ifdef CONFIG_HAVE__BOOTSERVICES
+#	if ((HAVE_SPMINTEREFACE) && ((FLASHEND) > 0xffff))
+#		define HAVE_BOOTSERVICES	1
+#	else
+#		warning "CONFIG_HAVE__BOOTSERVICES needs SPMINTEREFACE and more than 64k flash - disabled"
+#		define HAVE_BOOTSERVICES	0
+#	endif
+#else
+#	define HAVE_BOOTSERVICES	0
+#endif
+/* If HAVE_BOOTSERVICES is defined to 1, a small table of services follows
+ * "bootloader__do_spm" in the bootloader section: a flash range CRC16
+ * (same as "_crc16_update()") and a flash to SRAM copy, both able to
+ * read all of the flash via "elpm". Applications call them via
+ * "bootloader__crc16_far()" and "bootloader__memcpy_far()" of
+ * "spminterface.h" instead of linking own copies.
+ */
+
 #ifndef CONFIG_NO__EEPROM_PAGED_ACCESS
 #	define HAVE_EEPROM_PAGED_ACCESS    1
 #else
@@ -396,8 +414,9 @@ these macros are defined, the boot loader usees them.
 #else
 #	define PRESERVE_WATCHDOG	0
 #endif
-/* In case a watchdog is supported (NEED_WATCHDOG) and USE_EXCESSIVE_ASSEMBLER is false,
- * the bootloader will run with active watchdog instead of disabling it.
+/* In case a watchdog is supported (NEED_WATCHDOG), the bootloader will run
+ * with active watchdog instead of disabling it (also with USE_EXCESSIVE_ASSEMBLER,
+ * its assembler "leaveBootloader()" restores the watchdog as well).
  * After leaving the bootloader, the original watchdog state is restored.
  * WARNING: This might break compatibility with user firmwares, since they
  * need to be aware of watchdog enabled. (which could be enabled by some
@@ -448,6 +467,8 @@ these macros are defined, the boot loader usees them.
 /* This macro enables some (init3) code, executed at bootup.
  * This codefragment will safely overwrite the whole SRAM with "0"
  * (except registers and IO), since RESET will NOT clear old RAM content.
+ * .data and .bss are initialized by the C runtime anyway, .noinit and the
+ * boot address (and USB handoff mailbox) at RAMEND are left untouched.
  */
 
 #ifdef CONFIG_NO__BOOTLOADERENTRY_FROMSOFTWARE
@@ -460,6 +481,70 @@ these macros are defined, the boot loader usees them.
  * user intervention
  */
 
+#ifdef CONFIG_HAVE__USBHANDOFF
+#	if (HAVE_BOOTLOADERENTRY_FROMSOFTWARE)
+#		define HAVE_USBHANDOFF	1
+#	else
+#		warning "CONFIG_HAVE__USBHANDOFF needs BOOTLOADERENTRY_FROMSOFTWARE - disabled"
+#		define HAVE_USBHANDOFF	0
+#	endif
+#else
+#	define HAVE_USBHANDOFF	0
+#endif
+/*
+ * Warm USB handoff: A firmware running V-USB on the same pins and entering
+ * the bootloader via "BOOTLOADERENTRY_FROMSOFTWARE" may additionally place
+ * its USB address and "usbConfiguration" into a mailbox right below
+ * the bootloader address at RAMEND (see "appinterface.h").
+ * The bootloader then keeps the bus connection and continues on that
+ * address instead of the 250ms disconnect and a new enumeration. A bus
+ * reset by the host falls back to normal enumeration at address 0.
+ * With a port controlled pull-up (USB_CFG_PULLUP_IOPORTNAME) the pull-up is
+ * switched on again right away, as the reset released it; if the host saw
+ * the device detach meanwhile, it enumerates it anew.
+ * Only useful if the firmware enumerates with the same VID/PID (and
+ * descriptors) as the bootloader, since the host will not re-read them.
+ */
+
+#ifdef CONFIG_HAVE__USBTXDOUBLEBUFFER
+#	if (F_CPU >= 16000000)
+#		define HAVE_USBTXDOUBLEBUFFER	1
+#	else
+#		warning "CONFIG_HAVE__USBTXDOUBLEBUFFER needs F_CPU of 16MHz or more - disabled"
+#		define HAVE_USBTXDOUBLEBUFFER	0
+#	endif
+#else
+#	define HAVE_USBTXDOUBLEBUFFER	0
+#endif
+/*
+ * Double buffered transmit: while one data packet of a control-in transfer
+ * (flash or EEPROM read-back) is on the wire, the next one is already read
+ * and its CRC appended in a second buffer. This way the host's IN tokens are
+ * not NAKed while "usbFunctionRead()" runs. Costs 13 bytes RAM and stretches
+ * the IN response of the USB interrupt by 11 cycles, so it is only available
+ * with F_CPU >= 16MHz.
+ */
+
+#ifdef CONFIG_HAVE__RXQUEUE
+#	define HAVE_RXQUEUE		1
+#else
+#	define HAVE_RXQUEUE		0
+#endif
+#ifdef CONFIG_RXQUEUE_SLOTS
+#	define RXQUEUE_SLOTS		(CONFIG_RXQUEUE_SLOTS)
+#else
+#	define RXQUEUE_SLOTS		((SPM_PAGESIZE) / 8)
+#endif
+/*
+ * Receive queue: a flash page is erased and written in background and
+ * usbPoll() moves packets arriving meanwhile into a queue of RXQUEUE_SLOTS
+ * packets (12 bytes RAM each, default: one page of 8 byte packets). This
+ * way the USB interrupt keeps accepting data instead of NAKing it while
+ * "usbFunctionWrite()" waits for the flash. The queue is processed in
+ * order as soon as the page is written. Disables the hand-optimized
+ * assembler usbFunctionWrite().
+ */
+
 #ifdef CONFIG_NO__BOOTLOADER_HIDDENEXITCOMMAND
 #	define HAVE_BOOTLOADER_HIDDENEXITCOMMAND 0
 #else
@@ -487,6 +572,65 @@ these macros are defined, the boot loader usees them.
  * exit as long as bootLoaderConditionSimple stays on.
  */
 
+#ifdef CONFIG_BOOTLOADER_MSTIMEOUT
+#	define BOOTLOADER_MSTIMEOUT	(CONFIG_BOOTLOADER_MSTIMEOUT)
+#else
+#	define BOOTLOADER_MSTIMEOUT	(0)
+#endif
+/*
+ * When greater than "0", "BOOTLOADER_MSTIMEOUT" defines the timeout
+ * in milliseconds, after which the bootloader starts the user firmware.
+ * It replaces "BOOTLOADER_LOOPCYCLES_TIMEOUT": Instead of counting
+ * main loop iterations (whose duration depends on F_CPU and on USB
+ * traffic) the time is measured with the free running Timer1 (F_CPU/64).
+ * Timer1 is stopped and reset again before the firmware is started.
+ */
+
+#ifdef CONFIG_BOOTLOADER_MSDEBOUNCE
+#	define BOOTLOADER_MSDEBOUNCE	(CONFIG_BOOTLOADER_MSDEBOUNCE)
+#else
+#	define BOOTLOADER_MSDEBOUNCE	(0)
+#endif
+/*
+ * When greater than "0", the jumper (bootLoaderConditionSimple()) is
+ * only sampled every "BOOTLOADER_MSDEBOUNCE" milliseconds (Timer1) instead
+ * of every main loop iteration. To exit the bootloader the jumper has to
+ * be seen released for 15 and closed again for 7 samples.
+ * Must be shorter than 65536*64/F_CPU seconds (262ms at 16MHz).
+ */
+
+#if ((BOOTLOADER_MSTIMEOUT) || (BOOTLOADER_MSDEBOUNCE))
+#	define HAVE_BOOTLOADER_TIMER	1
+#else
+#	define HAVE_BOOTLOADER_TIMER	0
+#endif
+
+#define BOOTLOADER_HAVE_TIMEOUT	((BOOTLOADER_LOOPCYCLES_TIMEOUT) || (BOOTLOADER_MSTIMEOUT))
+
+#ifdef CONFIG_HAVE__IDLESLEEP
+#	if ((BOOTLOADER_LOOPCYCLES_TIMEOUT) && (BOOTLOADER_CAN_EXIT))
+#		warning "CONFIG_HAVE__IDLESLEEP stretches BOOTLOADER_LOOPCYCLES_TIMEOUT to minutes - use CONFIG_BOOTLOADER_MSTIMEOUT - disabled"
+#		define HAVE_IDLESLEEP		0
+#	else
+#		define HAVE_IDLESLEEP		1
+#	endif
+#else
+#	define HAVE_IDLESLEEP		0
+#endif
+/*
+ * When enabled, the main loop puts the MCU into SLEEP_MODE_IDLE whenever
+ * usbPoll() has nothing to do. The USB interrupt wakes it up again, so
+ * USB response latency does not suffer. Timer0 is used as an additional
+ * ~1ms wakeup source (USB reset detection, timeouts and watchdog).
+ * Reduces the average current while waiting for the host.
+ * Timer0 is stopped again before the firmware is started.
+ * A main loop iteration then takes up to 1ms instead of a few
+ * microseconds, so anything counted in loop iterations slows down:
+ * "BOOTLOADER_LOOPCYCLES_TIMEOUT" would grow to minutes, thus sleeping is
+ * only possible with "BOOTLOADER_MSTIMEOUT" (or without timeout). Without
+ * "BOOTLOADER_MSDEBOUNCE" the jumper is sampled about once per millisecond.
+ */
+
 #ifdef CONFIG_HAVE__BOOTLOADER_ABORTTIMEOUTONACT
 #endif
 /*
@@ -517,7 +661,7 @@ these macros are defined, the boot loader usees them.
  */
 
 #ifdef CONFIG_HAVE__BOOTLOADER_IGNOREPROGBUTTON
-#	if ( (BOOTLOADER_ALWAYSENTERPROGRAMMODE) && (defined(BOOTLOADER_CAN_EXIT)) && (BOOTLOADER_LOOPCYCLES_TIMEOUT >= 8) )
+#	if ( (BOOTLOADER_ALWAYSENTERPROGRAMMODE) && (defined(BOOTLOADER_CAN_EXIT)) && ((BOOTLOADER_LOOPCYCLES_TIMEOUT >= 8) || (BOOTLOADER_MSTIMEOUT >= 1500)) )
 #		define BOOTLOADER_IGNOREPROGBUTTON	1
 #	else
 #		define BOOTLOADER_IGNOREPROGBUTTON	0
@@ -531,12 +675,245 @@ these macros are defined, the boot loader usees them.
  * enabled, if "CONFIG_HAVE__BOOTLOADER_ALWAYSENTERPROGRAMMODE" is
  * enabled and "CONFIG_NO__BOOTLOADER_CAN_EXIT" is disabled, too.
  * Additionally "BOOTLOADER_LOOPCYCLES_TIMEOUT" must be greater 
- * or equal than 8 (In order to give user enough time to program).
+ * or equal than 8 (or "BOOTLOADER_MSTIMEOUT" at least 1500)
+ * (In order to give user enough time to program).
  * 
  * When active, "JUMPER_PORT" and "JUMPER_BIT" are ignored and
  * can be soldered otherwise.
  */
 
+#ifdef CONFIG_HAVE__BOOTLOADER_AUTOSTART
+#	if (BOOTLOADER_CAN_EXIT)
+#		define HAVE_BOOTLOADER_AUTOSTART	1
+#	else
+#		warning "CONFIG_HAVE__BOOTLOADER_AUTOSTART needs BOOTLOADER_CAN_EXIT (no CONFIG_NO__BOOTLOADER_CAN_EXIT) - disabled"
+#		define HAVE_BOOTLOADER_AUTOSTART	0
+#	endif
+#else
+#	define HAVE_BOOTLOADER_AUTOSTART	0
+#endif
+/*
+ * Auto-start the firmware after a verified image: The host first sends
+ * vendor request 65 with wValue set to the CRC16 (as of avr-libc's
+ * "_crc16_update()", start value 0xffff) over all flash data it is going
+ * to write. When the write request flagged as last page has been
+ * completed and the CRC over the received flash data matches, the
+ * bootloader starts the firmware right after acknowledging the write.
+ * A mismatch disarms the feature, the bootloader then stays active.
+ * Needs "BOOTLOADER_CAN_EXIT" (disabled with a warning otherwise) and
+ * disables the hand-optimized assembler usbFunctionWrite().
+ */
+
+#ifdef CONFIG_HAVE__APPSLOTS
+#	if ((FLASHEND) >= 0x1ffff)
+#		define HAVE_APPSLOTS		1
+#	else
+#		warning "CONFIG_HAVE__APPSLOTS needs at least 128k flash - disabled"
+#		define HAVE_APPSLOTS		0
+#	endif
+#else
+#	define HAVE_APPSLOTS		0
+#endif
+/*
+ * A/B application slots (only on MCUs with 128k flash or more):
+ * The application area is split into a trampoline page at 0x0000 and
+ * two equally sized slots. Each slot ends with a header page containing
+ * version, length and CRC of its image (see "appinterface.h").
+ * Uploads are only accepted for the inactive slot - the active image,
+ * all slot headers and the trampoline page are write protected (writing
+ * them will STALL) and chip erase only erases the inactive slot.
+ * Vendor requests:
+ *  66: slot info   (wValue = slot)         -> appslotinfo_t
+ *  67: commit      (wValue = slot, OUT appslotcommit_t): verify CRC of
+ *      the uploaded image, write its header and make it the active slot
+ *  68: select      (wValue = slot)         -> 1 byte, 0 = success:
+ *      make another valid slot active (rollback) by rewriting its header
+ * The bootloader jumps into the active slot via the trampoline page
+ * (nullVector), which is repaired before starting the firmware whenever
+ * it does not point to the active slot. If the header of the active slot
+ * becomes invalid, the other valid slot is started instead.
+ */
+
+#ifdef CONFIG_HAVE__APPMANIFEST
+#	if (HAVE_APPSLOTS)
+#		warning "CONFIG_HAVE__APPMANIFEST can not be combined with CONFIG_HAVE__APPSLOTS - disabled"
+#		define HAVE_APPMANIFEST		0
+#	else
+#		define HAVE_APPMANIFEST		1
+#	endif
+#else
+#	define HAVE_APPMANIFEST		0
+#endif
+#if ((HAVE_APPMANIFEST) && (HAVE_CHIP_ERASE) && (HAVE_ONDEMAND_PAGEERASE))
+#	define HAVE_APPMANIFEST_BOUNDEDERASE	1
+#else
+#	define HAVE_APPMANIFEST_BOUNDEDERASE	0
+#endif
+/*
+ * Application manifest: The host may store an image manifest (see
+ * "appinterface.h", generated by "tools/mkmanifest") in the last page
+ * below the bootloader, describing length, page count, CRC and the
+ * segments of flash actually used by the firmware.
+ * If a valid manifest is present, chip erase only erases the pages of
+ * the described segments plus the manifest page itself - small firmware
+ * on large MCUs then erases in milliseconds instead of seconds.
+ * This bounded erase needs "HAVE_ONDEMAND_PAGEERASE" (the default), which
+ * erases every other page right before it is written. Without it chip
+ * erase always erases the whole application area, since pages outside
+ * the manifest may hold data (e.g. written by the firmware itself).
+ * Vendor requests:
+ *  69: image crc                           -> appimagecrc_t:
+ *      CRC over the segments of the manifest (or the whole application
+ *      area without a valid manifest) and whether it matches
+ *  70: manifest                            -> appmanifest_t
+ *      (0 bytes if there is no valid manifest), lets host tools limit
+ *      read-back and verify to the used segments
+ * Can not be combined with "HAVE_APPSLOTS", which uses its own headers.
+ */
+
+#ifdef CONFIG_HAVE__WRITEVERIFY
+#	define HAVE_WRITEVERIFY		1
+#else
+#	define HAVE_WRITEVERIFY		0
+#endif
+/*
+ * Write-with-verify: While filling a flash page the bootloader keeps a
+ * CRC16 over the received bytes. After the page has been written it reads
+ * them back from flash and marks the page as failed in a bitmap (one bit
+ * per application page, bit set = mismatch) if the CRC differs.
+ * The host fetches the bitmap with vendor request 71 at the end of the
+ * session instead of reading back the whole image - the bitmap is cleared
+ * by USBASP_FUNC_CONNECT.
+ * Reading back costs a few hundred microseconds per page, little compared
+ * to the page write itself. Disables the hand-optimized assembler
+ * usbFunctionWrite().
+ */
+
+#ifdef CONFIG_HAVE__RXCRCCHECK
+#	define HAVE_RXCRCCHECK		1
+#else
+#	define HAVE_RXCRCCHECK		0
+#endif
+/*
+ * Check the CRC16 of every received data packet (V-USB acknowledges packets
+ * before their CRC is known). Flash data of a damaged packet is not filled
+ * into the page buffer and its page is neither erased nor written - instead
+ * the page is marked in a bitmap (one bit per application page) the host
+ * fetches with vendor request 74 to resend just those pages. Writing a page
+ * again clears its bit, USBASP_FUNC_CONNECT clears the whole bitmap.
+ * EEPROM data is not covered. Selects the faster CRC implementation of the
+ * USB driver and disables the hand-optimized assembler usbFunctionWrite().
+ */
+
+#if (((FLASHEND) > 0xffff) && (!(defined(CONFIG_NO__EXTENDEDADDRESS))))
+#	define HAVE_EXTENDEDADDRESS	1
+#else
+#	define HAVE_EXTENDEDADDRESS	0
+#endif
+/*
+ * Extended flash read/write requests for MCUs with more than 64k flash:
+ * Instead of USBASP_FUNC_SETLONGADDRESS followed by USBASP_FUNC_READFLASH
+ * or USBASP_FUNC_WRITEFLASH (two control transfers per block), the host
+ * sends a single request:
+ *  72: read flash   (wValue = address bits 0..15,
+ *  73: write flash   wIndex low byte = address bits 16..23,
+ *                    wIndex high byte = flags, wLength = length)
+ * Flags: 0x02 - last page (as with USBASP_FUNC_WRITEFLASH)
+ *        0x80 - auto-increment: ignore the address and continue where the
+ *               previous read or write stopped
+ */
+
+#ifdef CONFIG_HAVE__STAGEDUPDATE
+#	if ((HAVE_APPSLOTS) || (HAVE_APPMANIFEST))
+#		warning "CONFIG_HAVE__STAGEDUPDATE can not be combined with CONFIG_HAVE__APPSLOTS or CONFIG_HAVE__APPMANIFEST - disabled"
+#		define HAVE_STAGEDUPDATE	0
+#	else
+#		define HAVE_STAGEDUPDATE	1
+#	endif
+#else
+#	define HAVE_STAGEDUPDATE	0
+#endif
+/*
+ * Staged update: The running firmware downloads a new image into the
+ * upper half of the application area and writes a descriptor (length and
+ * CRC, see "appinterface.h") into the last page below the bootloader -
+ * both via "bootloader__do_spm", so no USB session is needed.
+ * At every reset (before evaluating the bootloader condition) the
+ * bootloader checks for a valid descriptor and staged image, copies every
+ * page differing from the staged one into the lower half and removes the
+ * descriptor after the copy has been verified.
+ * The application may use at most the lower half of the application area.
+ */
+
+#ifdef CONFIG_HAVE__IMAGEAUTH
+#	if ((HAVE_APPSLOTS) || (HAVE_STAGEDUPDATE))
+#		warning "CONFIG_HAVE__IMAGEAUTH can not be combined with CONFIG_HAVE__APPSLOTS or CONFIG_HAVE__STAGEDUPDATE - disabled"
+#		define HAVE_IMAGEAUTH		0
+#	elif (HAVE_BOOTSERVICES)
+#		warning "CONFIG_HAVE__IMAGEAUTH can not be combined with CONFIG_HAVE__BOOTSERVICES (reads the key for the application) - disabled"
+#		define HAVE_IMAGEAUTH		0
+#	elif (!(defined(CONFIG_IMAGEAUTH_KEY)))
+#		warning "CONFIG_HAVE__IMAGEAUTH needs CONFIG_IMAGEAUTH_KEY (four 32bit words) - disabled"
+#		define HAVE_IMAGEAUTH		0
+#	else
+#		define HAVE_IMAGEAUTH		1
+#	endif
+#else
+#	define HAVE_IMAGEAUTH		0
+#endif
+#ifdef CONFIG_IMAGEAUTH_EEADDR
+#	define IMAGEAUTH_EEADDR		(CONFIG_IMAGEAUTH_EEADDR)
+#else
+#	define IMAGEAUTH_EEADDR		(E2END)
+#endif
+/*
+ * Image authentication: The firmware is only started if it has been
+ * uploaded together with a valid XTEA CBC-MAC (see "appinterface.h" and
+ * "tools/imagemac"). The MAC is computed while the pages are written, so
+ * there is no extra pass over the flash. The result is kept as a flag in
+ * the EEPROM byte IMAGEAUTH_EEADDR (last byte by default), which the
+ * bootloader itself never lets the host write. Every flash write request
+ * or chip erase clears the flag (before touching the flash, since an EEPROM
+ * write discards the page buffer). Without a valid flag the bootloader does not
+ * leave.
+ * The key is compiled into the bootloader and has to stay secret:
+ * - The bootloader answers all host flash reads (READFLASH, READFLASHEX
+ *   and the ISP flash read commands) at or above the bootloader address
+ *   with 0xff.
+ * - Program BLB12, so that "lpm" of the application can not read the
+ *   bootloader section. The lock bits do not restrict reads done by the
+ *   bootloader's own code, hence:
+ * - "HAVE_BOOTSERVICES" (flash reads on behalf of the application) can
+ *   not be combined with it.
+ * Disables the hand-optimized assembler usbFunctionWrite().
+ */
+
+#ifdef CONFIG_HAVE__WEARLOG
+#	define HAVE_WEARLOG		1
+#else
+#	define HAVE_WEARLOG		0
+#endif
+#ifdef CONFIG_WEARLOG_PAGESHIFT
+#	define WEARLOG_PAGESHIFT	(CONFIG_WEARLOG_PAGESHIFT)
+#else
+#	define WEARLOG_PAGESHIFT	2
+#endif
+#ifdef CONFIG_WEARLOG_EEADDR
+#	define WEARLOG_EEADDR		(CONFIG_WEARLOG_EEADDR)
+#endif
+/*
+ * Flash wear log: the bootloader counts page erases in a table of 16bit
+ * counters in EEPROM, one counter per 2^WEARLOG_PAGESHIFT application pages
+ * (4 by default, 0 gives exact per page counts). By default the table ends
+ * at the top of EEPROM (right below IMAGEAUTH_EEADDR if used), so do not
+ * use this area from the application. Erases are only counted in RAM and
+ * added to the table at session end: in background after USBASP_FUNC_DISCONNECT
+ * (stopped by the next USBASP_FUNC_CONNECT) and completely before the
+ * bootloader starts the firmware. Counts of a session cut by power loss
+ * are lost. Counters never written read as 0xffff, see "appinterface.h".
+ * Disables the hand-optimized assembler usbFunctionWrite().
+ */
+
 #ifdef CONFIG_NO__BOOTLOADER_ADDITIONALDEVICEWAIT
 #	define HAVE_BOOTLOADER_ADDITIONALMSDEVICEWAIT 0
 #else
@@ -549,6 +926,30 @@ these macros are defined, the boot loader usees them.
  * This gives the pullups additional time to charge up.
  */
 
+#ifdef CONFIG_HAVE__ERASEAHEAD
+#	if ((HAVE_CHIP_ERASE) && (!(HAVE_ONDEMAND_PAGEERASE)))
+#		warning "CONFIG_HAVE__ERASEAHEAD needs ONDEMAND_PAGEERASE (or CONFIG_NO__CHIP_ERASE) - disabled"
+#		define HAVE_ERASEAHEAD		0
+#	else
+#		define HAVE_ERASEAHEAD		1
+#	endif
+#else
+#	define HAVE_ERASEAHEAD		0
+#endif
+/*
+ * Erase-ahead: The host may announce the pages it is going to write next
+ * with the vendor request 64 (wValue = first page number, wIndex = number
+ * of pages). While the bootloader is idle, the main loop erases these pages
+ * in background - one page per loop iteration - and remembers them in a
+ * page bitmap. Writing an already erased page then only needs the page-write
+ * step, which roughly halves the time USB is stalled at each page boundary.
+ * Pages not (yet) erased in background are still erased on demand, so
+ * this feature needs "HAVE_ONDEMAND_PAGEERASE" (or no "HAVE_CHIP_ERASE"),
+ * otherwise it is disabled with a warning.
+ * Costs one bit of RAM per application page and disables the hand-optimized
+ * assembler usbFunctionWrite().
+ */
+
 //#define SIGNATURE_BYTES             0x1e, 0x93, 0x07, 0     /* ATMega8 */
 /* This macro defines the signature bytes returned by the emulated USBasp to
  * the programmer software. They should match the actual device at least in
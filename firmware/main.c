@@ -18,7 +18,9 @@
 #include <avr/wdt.h>
 #include <avr/boot.h>
 #include <avr/eeprom.h>
+#include <avr/sleep.h>
 #include <util/delay.h>
+#include <util/crc16.h>
 
 
 #if 0
@@ -39,10 +41,12 @@
 #include <avr/boot.h>
 
 #include <string.h>
+#include <stddef.h>
 
 
 
 #include "bootloaderconfig.h"
+#include "appinterface.h"
 
 #include "usbdrv/usbdrv.c"
 static usbMsgLen_t usbFunctionDescriptor(struct usbRequest *rq) {
@@ -53,6 +57,7 @@ static usbMsgLen_t usbFunctionDescriptor(struct usbRequest *rq) {
   #error need to know the bootloaders flash address!
 #endif
 #define BOOTLOADER_PAGEADDR	(BOOTLOADER_ADDRESS - (BOOTLOADER_ADDRESS % SPM_PAGESIZE))
+#define APPLICATION_PAGECOUNT	((BOOTLOADER_PAGEADDR) / SPM_PAGESIZE)
 
 /* ------------------------------------------------------------------------ */
 
@@ -76,6 +81,26 @@ static usbMsgLen_t usbFunctionDescriptor(struct usbRequest *rq) {
 #define USBASP_FUNC_TPI_READBLOCK    15
 #define USBASP_FUNC_TPI_WRITEBLOCK   16
 #define USBASP_FUNC_GETCAPABILITIES 127
+
+/* USBaspLoader specific extensions (not used by USBasp or AVRDUDE) */
+#define USBASPLOADER_FUNC_ERASEAHEAD	64
+#define USBASPLOADER_FUNC_SETIMAGECRC	65
+#define USBASPLOADER_FUNC_SLOTINFO	66
+#define USBASPLOADER_FUNC_SLOTCOMMIT	67
+#define USBASPLOADER_FUNC_SLOTSELECT	68
+#define USBASPLOADER_FUNC_IMAGECRC	69
+#define USBASPLOADER_FUNC_MANIFEST	70
+#define USBASPLOADER_FUNC_VERIFYRESULT	71
+#define USBASPLOADER_FUNC_READFLASHEX	72
+#define USBASPLOADER_FUNC_WRITEFLASHEX	73
+#define USBASPLOADER_FUNC_RXCRCRESULT	74
+#define USBASPLOADER_FUNC_IMAGEAUTH	75
+#define USBASPLOADER_FUNC_WEARLOGINFO	76
+#define USBASPLOADER_FUNC_WEARLOG	77
+
+/* flags in wIndex high byte of USBASPLOADER_FUNC_READFLASHEX/WRITEFLASHEX */
+#define USBASPLOADER_EXFLAG_LASTPAGE	0x02
+#define USBASPLOADER_EXFLAG_AUTOINC	0x80
 /* ------------------------------------------------------------------------ */
 
 #ifndef ulong
@@ -105,9 +130,18 @@ static usbMsgLen_t usbFunctionDescriptor(struct usbRequest *rq) {
 #if (FLASHEND) > 0xffff /* we need long addressing */
 #   define CURRENT_ADDRESS  currentAddress.l
 #   define addr_t           ulong
+#   define flashReadByte(addr)	pgm_read_byte_far(addr)
 #else
 #   define CURRENT_ADDRESS  currentAddress.w[0]
 #   define addr_t           uint
+#   define flashReadByte(addr)	pgm_read_byte(addr)
+#endif
+
+#if (HAVE_IMAGEAUTH)
+/* flash reads on behalf of the host: the bootloader section holds the MAC key */
+#   define flashReadByteHost(addr)	(((addr_t)(addr) >= (addr_t)(BOOTLOADER_PAGEADDR)) ? 0xff : flashReadByte(addr))
+#else
+#   define flashReadByteHost(addr)	flashReadByte(addr)
 #endif
 
 typedef union longConverter{
@@ -117,13 +151,47 @@ typedef union longConverter{
 }longConverter_t;
 
 
-#define __IMPLEMENT_PRESERVE_WATCHDOG	((PRESERVE_WATCHDOG) && (!(USE_EXCESSIVE_ASSEMBLER)) && ((NEED_WATCHDOG) || (defined(__MCUCSR_COMPATMODE))))
+#define __IMPLEMENT_PRESERVE_WATCHDOG	((PRESERVE_WATCHDOG) && ((NEED_WATCHDOG) || (defined(__MCUCSR_COMPATMODE))))
 #if (__IMPLEMENT_PRESERVE_WATCHDOG)
 static uint8_t __original_WDTCR;
 #endif
 
+#if (HAVE_IDLESLEEP)
+/*
+ * Timer0 overflows about every millisecond (F_CPU/64/256) and wakes the
+ * CPU from idle sleep, so usbPoll() still sees USB resets (SE0 >= 10ms)
+ * and the main loop keeps serving timeouts and the watchdog.
+ */
+#	if defined(TCCR0B)
+#		define IDLESLEEP_TCCR0	TCCR0B
+#	else
+#		define IDLESLEEP_TCCR0	TCCR0
+#	endif
+#	if defined(TIMSK0)
+#		define IDLESLEEP_TIMSK	TIMSK0
+#	else
+#		define IDLESLEEP_TIMSK	TIMSK
+#	endif
+#	if defined (__AVR_ATmega128__)
+#		define IDLESLEEP_PRESCALER	(1 << CS02)			/* F_CPU/64 on async Timer0 */
+#	else
+#		define IDLESLEEP_PRESCALER	((1 << CS01) | (1 << CS00))	/* F_CPU/64 */
+#	endif
+EMPTY_INTERRUPT(TIMER0_OVF_vect);
+#endif
+
+#if (HAVE_BOOTLOADER_TIMER)
+/* Timer1 runs at F_CPU/64 */
+#	define BOOTLOADER_TIMER_TICKS(ms)	((((uint32_t)(ms)) * ((F_CPU) / 1000)) / 64)
+#	if ((((BOOTLOADER_MSDEBOUNCE) * ((F_CPU) / 1000)) / 64) > 0xffff)
+#		error "BOOTLOADER_MSDEBOUNCE is too large for this F_CPU"
+#	endif
+#endif
+
 #if (BOOTLOADER_CAN_EXIT)
-#	if (BOOTLOADER_LOOPCYCLES_TIMEOUT)
+#	if (BOOTLOADER_MSTIMEOUT)
+static uint32_t timeout_remaining;	/* in timer ticks */
+#	elif (BOOTLOADER_LOOPCYCLES_TIMEOUT)
 #		if (BOOTLOADER_LOOPCYCLES_TIMEOUT < 256)
 #			if ((HAVE_UNPRECISEWAIT))
 	 register uint8_t timeout_remaining __asm__("r2");
@@ -147,12 +215,116 @@ static volatile uint8_t stayinloader;
 static longConverter_t  	currentAddress; /* in bytes */
 static uchar            	bytesRemaining;
 static uchar            	isLastPage;
-#if HAVE_EEPROM_PAGED_ACCESS
+#define HAVE_CURRENTREQUEST		((HAVE_EEPROM_PAGED_ACCESS) || (HAVE_APPSLOTS) || (HAVE_IMAGEAUTH) || (HAVE_WEARLOG))
+#if HAVE_CURRENTREQUEST
 static uchar            	currentRequest;
 #else
 static const uchar      	currentRequest = 0;
 #endif
 
+/* one bit per page of the application section */
+#define PAGEBITMAP_SIZE			((APPLICATION_PAGECOUNT + 7) / 8)
+#define pageBitmapTest(map, page)	((map)[(page) >> 3] &   (1 << ((page) & 7)))
+#define pageBitmapSet(map, page)	((map)[(page) >> 3] |=  (1 << ((page) & 7)))
+#define pageBitmapClear(map, page)	((map)[(page) >> 3] &= ~(1 << ((page) & 7)))
+
+#if (HAVE_BOOTLOADER_AUTOSTART)
+#	define AUTOSTART_OFF		0
+#	define AUTOSTART_ARMED		1	/* expected CRC is known */
+#	define AUTOSTART_VERIFIED	2	/* last page written, CRC matched */
+static uchar			autoStartState;
+static uint16_t			imageCrc;	/* _crc16_update() over written flash data */
+static uint16_t			imageCrcExpected;
+#endif
+
+#if HAVE_ERASEAHEAD
+static uint			eraseAheadNext;	/* next page to erase in background */
+static uint			eraseAheadEnd;	/* first page not to erase anymore */
+static uchar			eraseAheadMap[PAGEBITMAP_SIZE]; /* erased and not written since */
+#endif
+
+#if (HAVE_APPSLOTS)
+#	define APPSLOT_SIZE		APPSLOT_SIZE_EX((addr_t)(BOOTLOADER_PAGEADDR), SPM_PAGESIZE)
+#	define APPSLOT_BASE(slot)	APPSLOT_BASE_EX(slot, (addr_t)(BOOTLOADER_PAGEADDR), SPM_PAGESIZE)
+#	define APPSLOT_HEADER(slot)	APPSLOT_HEADER_EX(slot, (addr_t)(BOOTLOADER_PAGEADDR), SPM_PAGESIZE)
+#	if (_VECTORS_SIZE > SPM_PAGESIZE)
+#		error "interrupt vectors do not fit into the trampoline page"
+#	endif
+static uchar			appSlotActive;		/* APPSLOT_NONE if there is no valid slot */
+static uchar			appSlotCommitSlot;
+static appslotcommit_t		appSlotCommitData;
+static appslotinfo_t		appSlotInfo;
+#endif
+
+#if (HAVE_APPMANIFEST)
+#	define APPMANIFEST_ADDR		((addr_t)APPMANIFEST_ADDR_EX((addr_t)(BOOTLOADER_PAGEADDR), SPM_PAGESIZE))
+static appmanifest_t		appManifest;
+static appimagecrc_t		appImageCrc;
+#endif
+
+#if (HAVE_STAGEDUPDATE)
+#	define APPSTAGE_BASE		((addr_t)APPSTAGE_BASE_EX((addr_t)(BOOTLOADER_PAGEADDR), SPM_PAGESIZE))
+#	define APPSTAGE_DESCRIPTOR	((addr_t)APPSTAGE_DESCRIPTOR_EX((addr_t)(BOOTLOADER_PAGEADDR), SPM_PAGESIZE))
+#endif
+
+#if (HAVE_WRITEVERIFY)
+/* CRC (start value 0) and count of the bytes filled into the current page */
+static uint16_t			writeVerifyCrc;
+static uint			writeVerifyCount;
+static uchar			writeVerifyFailMap[PAGEBITMAP_SIZE];
+#endif
+
+#if (HAVE_RXCRCCHECK)
+static uchar			rxCrcFailMap[PAGEBITMAP_SIZE];	/* pages with damaged data, not written */
+#endif
+
+#if (HAVE_IMAGEAUTH)
+/* stays in the bootloader section - protect it by lock bits */
+static const uint32_t		imageAuthKey[4] PROGMEM = { CONFIG_IMAGEAUTH_KEY };
+#	if (USB_CFG_DRIVER_FLASH_PAGE)
+#		define imageAuthKeyWord(i)	pgm_read_dword_far(((uint32_t)(USB_CFG_DRIVER_FLASH_PAGE) << 16) | (uint16_t)&imageAuthKey[(i)])
+#	else
+#		define imageAuthKeyWord(i)	pgm_read_dword(&imageAuthKey[(i)])
+#	endif
+#	define IMAGEAUTH_OFF		0
+#	define IMAGEAUTH_ARMED		1	/* length and MAC announced, image being written */
+#	define IMAGEAUTH_FAILED		2	/* image not written as announced */
+static uchar			imageAuthState;
+static uint32_t			imageAuthLength;
+static uint32_t			imageAuthCount;		/* image bytes processed */
+static uint32_t			imageAuthChain[2];	/* CBC chaining value */
+static uint32_t			imageAuthBlock[2];	/* block being collected */
+static uint32_t			imageAuthExpected[2];	/* MAC announced by the host */
+#endif
+
+#if (HAVE_WEARLOG)
+#	define WEARLOG_ENTRIES		((APPLICATION_PAGECOUNT + (1 << WEARLOG_PAGESHIFT) - 1) >> WEARLOG_PAGESHIFT)
+#	ifndef WEARLOG_EEADDR
+#		if (HAVE_IMAGEAUTH)
+#			define WEARLOG_EEADDR	((IMAGEAUTH_EEADDR) - (2 * WEARLOG_ENTRIES))
+#		else
+#			define WEARLOG_EEADDR	((E2END) + 1 - (2 * WEARLOG_ENTRIES))
+#		endif
+#	endif
+#	if ((WEARLOG_EEADDR) < 0) || (((WEARLOG_EEADDR) + (2 * WEARLOG_ENTRIES)) > ((E2END) + 1))
+#		error "the wear log does not fit into EEPROM - increase CONFIG_WEARLOG_PAGESHIFT"
+#	endif
+static uchar			wearLogPending[WEARLOG_ENTRIES];	/* erases not yet added to EEPROM */
+static uint			wearLogFlushNext = WEARLOG_ENTRIES;	/* next counter to update in background */
+static const appwearloginfo_t	wearLogInfo = { WEARLOG_EEADDR, WEARLOG_ENTRIES, WEARLOG_PAGESHIFT };
+#endif
+
+#if (HAVE_RXQUEUE)
+#	if ((RXQUEUE_SLOTS) < 1) || ((RXQUEUE_SLOTS) > 64)
+#		error "CONFIG_RXQUEUE_SLOTS must be 1 to 64"
+#	endif
+#	define PAGECOMMIT_IDLE		0
+#	define PAGECOMMIT_ERASING	1	/* page erase running, page buffer filled */
+#	define PAGECOMMIT_WRITING	2	/* page write running */
+static uchar			pageCommitState;
+static addr_t			pageCommitAddr;		/* address within the page */
+#endif
+
 static const uchar  signatureBytes[4] = {
 #ifdef SIGNATURE_BYTES
     SIGNATURE_BYTES
@@ -264,66 +436,223 @@ void __BOOTLOADERENTRY_FROMSOFTWARE__bootup_investigate_RAMEND(void) {
 }
 #endif
 
+#if (HAVE_USBHANDOFF)
+static volatile appusbhandoff_t __USBHANDOFF__bootup_mailbox __attribute__ ((section(".noinit")));
+
+/* save the mailbox before anything else touches the stack - and consume it */
+void __attribute__ ((section(".init3"),naked,used,no_instrument_function)) __USBHANDOFF__bootup_fetch(void);
+void __USBHANDOFF__bootup_fetch(void) {
+  volatile appusbhandoff_t *mailbox = (volatile appusbhandoff_t *)APPUSBHANDOFF_ADDR_EX(RAMEND, FLASHEND);
+
+  __USBHANDOFF__bootup_mailbox.magic         = mailbox->magic;
+  __USBHANDOFF__bootup_mailbox.deviceaddr    = mailbox->deviceaddr;
+  __USBHANDOFF__bootup_mailbox.configuration = mailbox->configuration;
+  __USBHANDOFF__bootup_mailbox.check         = mailbox->check;
+  mailbox->magic = 0;
+}
+
+static uchar usbHandoffValid(void) {
+  if (__BOOTLOADERENTRY_FROMSOFTWARE__bootup_MCUCSR & (~(_BV(WDRF)))) return 0;
+  if (__BOOTLOADERENTRY_FROMSOFTWARE__bootup_RAMEND_doesmatch != (__BOOTLOADERENTRY_FROMSOFTWARE__EXPECTEDADDRESS & 0xff)) return 0;
+  return (__USBHANDOFF__bootup_mailbox.magic == APPUSBHANDOFF_MAGIC) &&
+	 (__USBHANDOFF__bootup_mailbox.deviceaddr < 128) &&
+	 (__USBHANDOFF__bootup_mailbox.check == (uchar)~(APPUSBHANDOFF_MAGIC ^ __USBHANDOFF__bootup_mailbox.deviceaddr ^ __USBHANDOFF__bootup_mailbox.configuration));
+}
+#endif
+
 #if (USE_BOOTUP_CLEARRAM)
+/*
+ * End (exclusive) of the RAM cleared at bootup: the boot address stored by
+ * the firmware at RAMEND (and the USB handoff mailbox below it) are left for
+ * the other .init3 code - the stack overwrites them anyway.
+ */
+#if (HAVE_USBHANDOFF)
+#  define CLEARRAM_END	(APPUSBHANDOFF_ADDR_EX(RAMEND, FLASHEND))
+#elif (HAVE_BOOTLOADERENTRY_FROMSOFTWARE)
+#  define CLEARRAM_END	((RAMEND) + 1 - (((FLASHEND) > 131071) ? 3 : 2))
+#else
+#  define CLEARRAM_END	((RAMEND) + 1)
+#endif
+
 /*
 * Under normal circumstances, RESET will not clear contents of RAM.
 * As always, if you want it done - do it yourself...
+* .data and .bss are initialized by the C runtime and .noinit holds the
+* results of the other .init3 code, so only the RAM from "__heap_start" to
+* CLEARRAM_END is cleared: first (size % 8) single bytes, then blocks of
+* 8 bytes, 2.5 cycles per byte instead of 6 of the former byte loop. The
+* same loops in tools/avrsimcheck.S, measured by tools/clearram.sim:
+* 2048 bytes (all SRAM of an ATmega328p) take 5146 instead of 12292
+* cycles, i.e. 322 instead of 768 us at 16 MHz.
 */
 void __attribute__ ((section(".init3"),naked,used,no_instrument_function)) __func_clearram(void);
 void __func_clearram(void) {
-  extern size_t __bss_end;
+  extern uint8_t __heap_start;
   asm volatile (
-    "__clearram:\n\t"
-#if (!(HAVE_BOOTLOADERENTRY_FROMSOFTWARE))
-    "ldi r29, %[ramendhi]\n\t"
-    "ldi r28, %[ramendlo]\n\t"
-#endif
-    "__clearramloop%=:\n\t"
-    "st -Y , __zero_reg__\n\t"
-    "cp r28, %A[bssend]\n\t"
-    "cpc r29, %B[bssend]\n\t"
-    "brne __clearramloop%=\n\t"
+    "ldi	r30		,	lo8(%[start])\n\t"
+    "ldi	r31		,	hi8(%[start])\n\t"
+    "ldi	r24		,	lo8(%[end])\n\t"
+    "ldi	r25		,	hi8(%[end])\n\t"
+    "sub	r24		,	r30\n\t"
+    "sbc	r25		,	r31\n\t"
+    "brcs	__clearram_done%=\n\t"
+    "mov	r23		,	r24\n\t"
+    "andi	r23		,	7\n\t"
+    "rjmp	__clearram_bytetest%=\n\t"
+    "__clearram_byte%=:\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "__clearram_bytetest%=:\n\t"
+    "subi	r23		,	1\n\t"
+    "brcc	__clearram_byte%=\n\t"
+    "lsr	r25\n\t"
+    "ror	r24\n\t"
+    "lsr	r25\n\t"
+    "ror	r24\n\t"
+    "lsr	r25\n\t"
+    "ror	r24\n\t"
+    "rjmp	__clearram_blocktest%=\n\t"
+    "__clearram_block%=:\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "st		Z+		,	__zero_reg__\n\t"
+    "__clearram_blocktest%=:\n\t"
+    "sbiw	r24		,	1\n\t"
+    "brcc	__clearram_block%=\n\t"
+    "__clearram_done%=:\n\t"
     :
-    : [ramendhi] "M" (((RAMEND+1)>>8) & 0xff),
-      [ramendlo] "M" (((RAMEND+1)>>0) & 0xff),
-      [bssend] "r" (&__bss_end)
-    : "memory"
+    : [start] "i" (&__heap_start),
+      [end]   "i" (CLEARRAM_END)
+    : "r23", "r24", "r25", "r30", "r31", "memory"
       );
 }
 #endif
 
-#if (!USE_EXCESSIVE_ASSEMBLER) || (!(defined (__AVR_ATmega8__) || defined (__AVR_ATmega8A__) || defined (__AVR_ATmega8HVA__)))
+/*
+ * The assembler version of "leaveBootloader()" does the same as the C version
+ * below (except for debug output). Registers are accessed by "out"/"sbi" or
+ * "lds"/"sts" depending on their address, which is decided by the assembler.
+ */
+#define USE_ASM_LEAVEBOOTLOADER	((USE_EXCESSIVE_ASSEMBLER) && (DEBUG_LEVEL < 1))
+
+#if (!(USE_ASM_LEAVEBOOTLOADER))
 static void (*nullVector)(void) __attribute__((__noreturn__));
 #endif
 
-#if (USE_EXCESSIVE_ASSEMBLER) && (defined (__AVR_ATmega8__) || defined (__AVR_ATmega8A__) || defined (__AVR_ATmega8HVA__))
+#if (USE_ASM_LEAVEBOOTLOADER)
+/* store "reg" to "sfr" (data memory address) */
+#define LEAVE_ASM_STORE(sfr, reg)	".if " sfr " < 0x60\n\t"		\
+					"out	" sfr "-0x20,	" reg "\n\t"	\
+					".else\n\t"				\
+					"sts	" sfr ",	" reg "\n\t"	\
+					".endif\n\t"
+/* set or clear "bit" of "sfr" (data memory address), clobbers r24 */
+#define LEAVE_ASM_SETBIT(sfr, bit)	".if " sfr " < 0x40\n\t"		\
+					"sbi	" sfr "-0x20,	" bit "\n\t"	\
+					".else\n\t"				\
+					"lds	r24,	" sfr "\n\t"		\
+					"ori	r24,	1<<" bit "\n\t"	\
+					"sts	" sfr ",	r24\n\t"	\
+					".endif\n\t"
+#define LEAVE_ASM_CLRBIT(sfr, bit)	".if " sfr " < 0x40\n\t"		\
+					"cbi	" sfr "-0x20,	" bit "\n\t"	\
+					".else\n\t"				\
+					"lds	r24,	" sfr "\n\t"		\
+					"andi	r24,	0xff^(1<<" bit ")\n\t"	\
+					"sts	" sfr ",	r24\n\t"	\
+					".endif\n\t"
+
 static void __attribute__((naked,__noreturn__)) leaveBootloader(void);
 static void leaveBootloader(void) {
   asm  volatile  (
   "cli\n\t"
-  "sbi		%[usbddr],	%[usbminus]\n\t"  
-  "cbi		%[port],	%[bit]\n\t"
-  "out		%[usbintrenab],	__zero_reg__\n\t"
-  "out		%[usbintrcfg],	__zero_reg__\n\t"
-  "ldi		r31,		%[ivce]\n\t"
-  "out		%[mygicr],	r31\n\t"
-  "out		%[mygicr],	__zero_reg__\n\t"  
+#ifdef USB_CFG_PULLUP_IOPORTNAME
+  LEAVE_ASM_CLRBIT("%[pullupddr]", "%[pullupbit]")
+  LEAVE_ASM_CLRBIT("%[pullupout]", "%[pullupbit]")
+#else
+  LEAVE_ASM_SETBIT("%[usbddr]", "%[usbminus]")
+#endif
+#if (!(BOOTLOADER_IGNOREPROGBUTTON)) && (!defined(BOOTLOADER_INIT))
+  LEAVE_ASM_STORE("%[port]", "__zero_reg__")
+#endif
+  LEAVE_ASM_STORE("%[usbintrenab]", "__zero_reg__")
+  LEAVE_ASM_STORE("%[usbintrcfg]", "__zero_reg__")
+  "ldi		r24,		%[ivce]\n\t"
+  LEAVE_ASM_STORE("%[mygicr]", "r24")
+  LEAVE_ASM_STORE("%[mygicr]", "__zero_reg__")
+#if (HAVE_IDLESLEEP)
+  LEAVE_ASM_STORE("%[timsk]", "__zero_reg__")
+  LEAVE_ASM_STORE("%[tccr0]", "__zero_reg__")
+#endif
+#if (HAVE_BOOTLOADER_TIMER)
+  LEAVE_ASM_STORE("%[tccr1b]", "__zero_reg__")
+  LEAVE_ASM_STORE("%[tcnt1h]", "__zero_reg__")
+  LEAVE_ASM_STORE("%[tcnt1l]", "__zero_reg__")
+#endif
+#if (__IMPLEMENT_PRESERVE_WATCHDOG)
+  /* WDTCR is written within four cycles after setting WDCE */
+  "lds		r24,		%[origwdtcr]\n\t"
+  "sbrs		r24,		%[wde]\n\t"
+  "rjmp		leaveBootloader_wdtdone\n\t"
+  "andi		r24,		0xff^(1<<%[wdce])\n\t"
+  "wdr\n\t"
+  "lds		r25,		%[wdtcr]\n\t"
+  "ori		r25,		(1<<%[wdce])|(1<<%[wde])\n\t"
+  "sts		%[wdtcr],	r25\n\t"
+  "sts		%[wdtcr],	r24\n\t"
+  "wdr\n\t"
+  "leaveBootloader_wdtdone:\n\t"
+#endif
+#if (defined(EIND) && ((FLASHEND)>131071))
+  LEAVE_ASM_STORE("%[eind]", "__zero_reg__")
+#endif
+#if ((FLASHEND) > 0x1fff)
+  "jmp		nullVector\n\t"
+#else
   "rjmp		nullVector\n\t"
+#endif
   :
-  : [port]        "I" (_SFR_IO_ADDR(PIN_PORT(JUMPER_PORT))),
-    [bit]         "I" (PIN(JUMPER_PORT, JUMPER_BIT)),
-    [usbintrenab] "I" (_SFR_IO_ADDR(USB_INTR_ENABLE)),
-    [usbintrcfg]  "I" (_SFR_IO_ADDR(USB_INTR_CFG)),
-    [usbddr]      "I" (_SFR_IO_ADDR(USBDDR)),
+  : [port]        "n" (_SFR_MEM_ADDR(PIN_PORT(JUMPER_PORT))),
+#ifdef USB_CFG_PULLUP_IOPORTNAME
+    [pullupddr]   "n" (_SFR_MEM_ADDR(USB_PULLUP_DDR)),
+    [pullupout]   "n" (_SFR_MEM_ADDR(USB_PULLUP_OUT)),
+    [pullupbit]   "I" (USB_CFG_PULLUP_BIT),
+#endif
+    [usbintrenab] "n" (_SFR_MEM_ADDR(USB_INTR_ENABLE)),
+    [usbintrcfg]  "n" (_SFR_MEM_ADDR(USB_INTR_CFG)),
+    [usbddr]      "n" (_SFR_MEM_ADDR(USBDDR)),
     [usbminus]    "I" (USBMINUS),
-    [mygicr]      "I" (_SFR_IO_ADDR(GICR)),	      
-    [ivce]        "I" (1<<IVCE)
+    [mygicr]      "n" (_SFR_MEM_ADDR(GICR)),
+#if (HAVE_IDLESLEEP)
+    [timsk]       "n" (_SFR_MEM_ADDR(IDLESLEEP_TIMSK)),
+    [tccr0]       "n" (_SFR_MEM_ADDR(IDLESLEEP_TCCR0)),
+#endif
+#if (HAVE_BOOTLOADER_TIMER)
+    [tccr1b]      "n" (_SFR_MEM_ADDR(TCCR1B)),
+    [tcnt1h]      "n" (_SFR_MEM_ADDR(TCNT1H)),
+    [tcnt1l]      "n" (_SFR_MEM_ADDR(TCNT1L)),
+#endif
+#if (__IMPLEMENT_PRESERVE_WATCHDOG)
+    [origwdtcr]   "i" (&__original_WDTCR),
+    [wdtcr]       "n" (_SFR_MEM_ADDR(WDTCR)),
+    [wde]         "I" (WDE),
+    [wdce]        "I" (WDCE),
+#endif
+#if (defined(EIND) && ((FLASHEND)>131071))
+    [eind]        "n" (_SFR_MEM_ADDR(EIND)),
+#endif
+    [ivce]        "M" (1<<IVCE)
 );
 }
 #else
 static void __attribute__((__noreturn__)) leaveBootloader(void);
 static void leaveBootloader(void) {
     DBG1(0x01, 0, 0);
+    odDebugFlush();
     cli();
     usbDeviceDisconnect();
     bootLoaderExit();
@@ -331,6 +660,14 @@ static void leaveBootloader(void) {
     USB_INTR_CFG = 0;       /* also reset config bits */
     GICR = (1 << IVCE);     /* enable change of interrupt vectors */
     GICR = (0 << IVSEL);    /* move interrupts to application flash section */
+#if (HAVE_IDLESLEEP)
+    IDLESLEEP_TIMSK &= ~(1 << TOIE0);  /* stop the idle wakeup timer */
+    IDLESLEEP_TCCR0 = 0;
+#endif
+#if (HAVE_BOOTLOADER_TIMER)
+    TCCR1B = 0;             /* stop and reset the timeout timer */
+    TCNT1  = 0;
+#endif
 
 /* restore the original watchdog timer if necessary */
 #if (__IMPLEMENT_PRESERVE_WATCHDOG)
@@ -363,6 +700,589 @@ static void leaveBootloader(void) {
 /* ------------------------------------------------------------------------ */
 
 
+#if (HAVE_APPSLOTS)
+/* slot containing "addr" or APPSLOT_NONE (trampoline page, bootloader) */
+static uchar appSlotOf(addr_t addr) {
+  if (addr < APPSLOT_BASE(0))			return APPSLOT_NONE;
+  if (addr < APPSLOT_BASE(1))			return 0;
+  if (addr < (APPSLOT_BASE(1) + APPSLOT_SIZE))	return 1;
+  return APPSLOT_NONE;
+}
+
+/* the host may only write images into inactive slots, but not their headers */
+static uchar appSlotWritable(addr_t addr) {
+  uchar slot = appSlotOf(addr);
+
+  return (slot != APPSLOT_NONE) && (slot != appSlotActive) && (addr < APPSLOT_HEADER(slot));
+}
+#endif
+
+#if (HAVE_WEARLOG)
+/* called for every page erase */
+static void wearLogCount(addr_t addr) {
+  uint entry = (addr / SPM_PAGESIZE) >> WEARLOG_PAGESHIFT;
+
+  if ((entry < WEARLOG_ENTRIES) && (wearLogPending[entry] != 0xff)) wearLogPending[entry]++;
+}
+
+/*
+ * Called once per main loop iteration: add the pending erases of the next
+ * counter to EEPROM. An EEPROM write may not overlap SPM and would discard
+ * a partially filled page buffer - so only run between sessions and wait
+ * for the write to complete.
+ */
+static void wearLogPoll(void) {
+  if ((wearLogFlushNext < WEARLOG_ENTRIES) && (!boot_spm_busy())
+#   if (HAVE_RXQUEUE)
+      && (pageCommitState == PAGECOMMIT_IDLE)	/* page buffer filled while the page is erased */
+#   endif
+     ) {
+    if (wearLogPending[wearLogFlushNext]) {
+      uint16_t *counter = (uint16_t *)(WEARLOG_EEADDR + (2 * wearLogFlushNext));
+      uint16_t  value   = eeprom_read_word(counter);
+
+      if (value == APPWEARLOG_UNUSED) value = 0;
+      value += wearLogPending[wearLogFlushNext];
+      if ((value > APPWEARLOG_MAX) || (value < wearLogPending[wearLogFlushNext])) value = APPWEARLOG_MAX;
+      eeprom_update_word(counter, value);
+      eeprom_busy_wait();
+      wearLogPending[wearLogFlushNext] = 0;
+    }
+    wearLogFlushNext++;
+  }
+}
+
+/* add all pending erases to EEPROM before the firmware is started */
+static void wearLogFlush(void) {
+  wearLogFlushNext = 0;
+  while (wearLogFlushNext < WEARLOG_ENTRIES) wearLogPoll();
+}
+#endif
+
+#if HAVE_ERASEAHEAD
+/*
+ * Called once per main loop iteration: start erasing the next announced
+ * page if neither SPM nor EEPROM are busy. The erase runs in background
+ * (RWW section) while the bootloader keeps serving USB.
+ */
+static void eraseAheadPoll(void) {
+  if ((eraseAheadNext < eraseAheadEnd) && (!boot_spm_busy()) && (eeprom_is_ready())) {
+    if ((!pageBitmapTest(eraseAheadMap, eraseAheadNext))
+#   if (HAVE_APPSLOTS)
+	&& (appSlotWritable((addr_t)eraseAheadNext * SPM_PAGESIZE))
+#   endif
+       ) {
+      DBG1(0x36, (void *)&eraseAheadNext, 2);
+#   ifndef NO_FLASH_WRITE
+      cli();
+      boot_page_erase((addr_t)eraseAheadNext * SPM_PAGESIZE);
+      sei();
+#       if (HAVE_WEARLOG)
+      wearLogCount((addr_t)eraseAheadNext * SPM_PAGESIZE);
+#       endif
+#   endif
+      pageBitmapSet(eraseAheadMap, eraseAheadNext);
+    }
+    eraseAheadNext++;
+  }
+}
+
+/*
+ * Called before the page containing "addr" is written.
+ * Returns non-zero if the page has already been erased in background.
+ */
+static uchar eraseAheadClaim(addr_t addr) {
+  uint  page = addr / SPM_PAGESIZE;
+  uchar rval = 0;
+
+  if (page < APPLICATION_PAGECOUNT) {
+    /* never erase a page behind the host, it may already have been written */
+    if ((page >= eraseAheadNext) && (page < eraseAheadEnd)) eraseAheadNext = page + 1;
+    rval = pageBitmapTest(eraseAheadMap, page);
+    pageBitmapClear(eraseAheadMap, page);
+  }
+  return rval;
+}
+
+/*
+ * A background erase leaves the RWW section disabled. Re-enable it before
+ * reading flash. (This also discards the temporary page buffer, so hosts
+ * must not read flash in the middle of writing a page.)
+ */
+static void eraseAheadRwwSync(void) {
+  if (boot_rww_busy()) {
+    boot_spm_busy_wait();
+    cli();
+    boot_rww_enable();
+    sei();
+  }
+}
+#endif
+
+#if (HAVE_APPSLOTS)
+static void appSlotPageFill(addr_t addr, uint16_t word) {
+  boot_spm_busy_wait();
+  cli();
+  boot_page_fill(addr, word);
+  sei();
+}
+
+static void appSlotPageWrite(addr_t addr) {
+#   ifndef NO_FLASH_WRITE
+  cli();
+  boot_page_erase(addr);
+  sei();
+#       if (HAVE_WEARLOG)
+  wearLogCount(addr);
+#       endif
+  boot_spm_busy_wait();
+  cli();
+  boot_page_write(addr);
+  sei();
+  boot_spm_busy_wait();
+  cli();
+  boot_rww_enable();
+  sei();
+#   endif
+}
+
+static uint16_t appSlotHeaderCrc(appslotheader_t *hdr) {
+  uint16_t crc = 0xffff;
+  uchar    i;
+
+  for (i = 0; i < offsetof(appslotheader_t, hdrcrc); i++) crc = _crc16_update(crc, ((uchar *)hdr)[i]);
+  return crc;
+}
+
+static void appSlotReadHeader(uchar slot, appslotheader_t *hdr) {
+  addr_t addr = APPSLOT_HEADER(slot);
+  uchar  i;
+
+#   if HAVE_ERASEAHEAD
+  eraseAheadRwwSync();
+#   endif
+  for (i = 0; i < sizeof(appslotheader_t); i++) ((uchar *)hdr)[i] = pgm_read_byte_far(addr + i);
+}
+
+static uchar appSlotValid(uchar slot, appslotheader_t *hdr) {
+  appSlotReadHeader(slot, hdr);
+  return (hdr->magic == APPSLOT_MAGIC) && (hdr->hdrcrc == appSlotHeaderCrc(hdr));
+}
+
+static uchar appSlotFindActive(void) {
+  appslotheader_t h0, h1;
+  uchar v0 = appSlotValid(0, &h0);
+  uchar v1 = appSlotValid(1, &h1);
+
+  if (v0 && v1)	return (((int16_t)(h1.sequence - h0.sequence)) > 0) ? 1 : 0;
+  if (v0)	return 0;
+  if (v1)	return 1;
+  return APPSLOT_NONE;
+}
+
+/* sequence number making a slot newer than the currently active one */
+static uint16_t appSlotNextSequence(void) {
+  appslotheader_t hdr;
+
+  if (appSlotActive == APPSLOT_NONE) return 0;
+  appSlotReadHeader(appSlotActive, &hdr);
+  return hdr.sequence + 1;
+}
+
+static void appSlotWriteHeader(uchar slot, appslotheader_t *hdr) {
+  addr_t addr = APPSLOT_HEADER(slot);
+  uint   i;
+
+  hdr->hdrcrc = appSlotHeaderCrc(hdr);
+  for (i = 0; i < SPM_PAGESIZE; i += 2) {
+    if (i < sizeof(appslotheader_t))	appSlotPageFill(addr + i, ((uchar *)hdr)[i] | (((uint16_t)((uchar *)hdr)[i+1]) << 8));
+    else				appSlotPageFill(addr + i, 0xffff);
+  }
+  appSlotPageWrite(addr);
+}
+
+/* "jmp k" opcode words, k being a word address */
+#define APPSLOT_JMP_HI(k)	(0x940c | ((uint16_t)((k) >> 13) & 0x1f0) | ((uint16_t)((k) >> 16) & 0x01))
+#define APPSLOT_JMP_LO(k)	((uint16_t)(k))
+
+static uchar appSlotTrampolineOk(uchar slot) {
+  addr_t k = APPSLOT_BASE(slot) >> 1;
+
+  return (pgm_read_word_far(0) == APPSLOT_JMP_HI(k)) && (pgm_read_word_far(2) == APPSLOT_JMP_LO(k));
+}
+
+/* page 0: one "jmp" per interrupt vector into the vector table of "slot" */
+static void appSlotWriteTrampoline(uchar slot) {
+  addr_t k = APPSLOT_BASE(slot) >> 1;
+  uint   i;
+
+  for (i = 0; i < SPM_PAGESIZE; i += 4) {
+    if (i < _VECTORS_SIZE) {
+      appSlotPageFill(i + 0, APPSLOT_JMP_HI(k + (i >> 1)));
+      appSlotPageFill(i + 2, APPSLOT_JMP_LO(k + (i >> 1)));
+    } else {
+      appSlotPageFill(i + 0, 0xffff);
+      appSlotPageFill(i + 2, 0xffff);
+    }
+  }
+  appSlotPageWrite(0);
+}
+
+/* verify the uploaded image and make it the active slot */
+static uchar appSlotCommit(uchar slot) {
+  appslotheader_t hdr;
+  addr_t          addr = APPSLOT_BASE(slot);
+  uint32_t        n    = appSlotCommitData.length;
+  uint16_t        crc  = 0xffff;
+
+  if ((slot > 1) || (slot == appSlotActive)) return 0;
+  if ((n == 0) || (n > (APPSLOT_SIZE - SPM_PAGESIZE))) return 0;
+#   if HAVE_ERASEAHEAD
+  eraseAheadRwwSync();
+#   endif
+  while (n--) {
+    crc = _crc16_update(crc, pgm_read_byte_far(addr++));
+  }
+  if (crc != appSlotCommitData.crc) return 0;
+
+  hdr.magic    = APPSLOT_MAGIC;
+  hdr.sequence = appSlotNextSequence();
+  hdr.version  = appSlotCommitData.version;
+  hdr.crc      = appSlotCommitData.crc;
+  hdr.length   = appSlotCommitData.length;
+  appSlotWriteHeader(slot, &hdr);
+  appSlotWriteTrampoline(slot);
+  appSlotActive = slot;
+  return 1;
+}
+
+/* make another (valid) slot the active one - e.g. roll back an update */
+static uchar appSlotSelect(uchar slot) {
+  appslotheader_t hdr;
+
+  if ((slot > 1) || (!appSlotValid(slot, &hdr))) return 0;
+  if (slot != appSlotActive) {
+    hdr.sequence = appSlotNextSequence();
+    appSlotWriteHeader(slot, &hdr);
+    appSlotActive = slot;
+  }
+  if (!appSlotTrampolineOk(slot)) appSlotWriteTrampoline(slot);
+  return 1;
+}
+
+/* called right before starting the firmware: repair the trampoline if necessary */
+static void appSlotPrepareStart(void) {
+  uchar slot = appSlotFindActive();
+
+  if ((slot != APPSLOT_NONE) && (!appSlotTrampolineOk(slot))) appSlotWriteTrampoline(slot);
+}
+#endif
+
+#if (HAVE_APPMANIFEST)
+/* load the manifest into "appManifest", returns 0 if there is no valid one */
+static uchar appManifestLoad(void) {
+  uint16_t crc = 0xffff;
+  uchar    i;
+
+#   if HAVE_ERASEAHEAD
+  eraseAheadRwwSync();
+#   endif
+  for (i = 0; i < sizeof(appmanifest_t); i++) {
+    ((uchar *)&appManifest)[i] = flashReadByte(APPMANIFEST_ADDR + i);
+    if (i < offsetof(appmanifest_t, mancrc)) crc = _crc16_update(crc, ((uchar *)&appManifest)[i]);
+  }
+  if ((appManifest.magic != APPMANIFEST_MAGIC) || (appManifest.version != APPMANIFEST_VERSION) ||
+      (appManifest.segments == 0) || (appManifest.segments > APPMANIFEST_MAXSEGMENTS) ||
+      (appManifest.mancrc != crc)) return 0;
+  for (i = 0; i < appManifest.segments; i++) {
+    if ((appManifest.segment[i].length > APPMANIFEST_ADDR) ||
+        (appManifest.segment[i].start > (APPMANIFEST_ADDR - appManifest.segment[i].length))) return 0;
+  }
+  return 1;
+}
+
+#   if (HAVE_APPMANIFEST_BOUNDEDERASE)
+/* is the page at "addr" part of the image of a valid (loaded) manifest or the manifest itself */
+static uchar appManifestPageUsed(addr_t addr) {
+  uchar i;
+
+  if (addr == APPMANIFEST_ADDR) return 1;
+  for (i = 0; i < appManifest.segments; i++) {
+    if (((addr + SPM_PAGESIZE) > appManifest.segment[i].start) &&
+        (addr < (appManifest.segment[i].start + appManifest.segment[i].length))) return 1;
+  }
+  return 0;
+}
+#   endif
+
+static void appImageCrcUpdate(void) {
+  uint16_t crc = 0xffff;
+  uchar    i;
+
+  appImageCrc.manifest = appManifestLoad();
+  if (!appImageCrc.manifest) {
+    appManifest.segments          = 1;
+    appManifest.segment[0].start  = 0;
+    appManifest.segment[0].length = (addr_t)(BOOTLOADER_PAGEADDR);
+  }
+  appImageCrc.length = 0;
+  for (i = 0; i < appManifest.segments; i++) {
+    addr_t   addr = appManifest.segment[i].start;
+    uint32_t n    = appManifest.segment[i].length;
+
+    appImageCrc.length += n;
+    while (n--) crc = _crc16_update(crc, flashReadByte(addr++));
+  }
+  appImageCrc.crc = crc;
+  if ((appImageCrc.manifest) && (crc != appManifest.crc)) appImageCrc.manifest = 2;
+}
+#endif
+
+#if (HAVE_WRITEVERIFY)
+/* compare the just written page ending at "last" with the data filled in */
+static void writeVerifyPage(addr_t last) {
+  addr_t   addr = last + 1 - writeVerifyCount;
+  uint16_t crc  = 0;
+
+  while (addr <= last) crc = _crc16_update(crc, flashReadByte(addr++));
+  if ((crc != writeVerifyCrc) && ((last / SPM_PAGESIZE) < APPLICATION_PAGECOUNT)) {
+    pageBitmapSet(writeVerifyFailMap, last / SPM_PAGESIZE);
+  }
+  writeVerifyCrc   = 0;
+  writeVerifyCount = 0;
+}
+#endif
+
+#if (HAVE_RXQUEUE)
+/* start erasing (if "erase") and writing the filled page buffer to "addr" */
+static void pageCommitStart(addr_t addr, uchar erase) {
+  pageCommitAddr  = addr;
+  pageCommitState = PAGECOMMIT_WRITING;
+#   ifndef NO_FLASH_WRITE
+  cli();
+  if (erase) {
+    DBG1(0x33, 0, 0);
+    boot_page_erase(addr);
+    pageCommitState = PAGECOMMIT_ERASING;
+  } else {
+    DBG1(0x34, 0, 0);
+    boot_page_write(addr);
+  }
+  sei();
+#       if (HAVE_WEARLOG)
+  if (erase) wearLogCount(addr);
+#       endif
+#   endif
+}
+
+/* called once per main loop iteration (and by usbRxQueueHold()): advance a running commit */
+static void pageCommitPoll(void) {
+  if ((pageCommitState == PAGECOMMIT_IDLE) || (boot_spm_busy())) return;
+#   ifndef NO_FLASH_WRITE
+  cli();
+  if (pageCommitState == PAGECOMMIT_ERASING) {
+    DBG1(0x34, 0, 0);
+    boot_page_write(pageCommitAddr);
+    sei();
+    pageCommitState = PAGECOMMIT_WRITING;
+    return;
+  }
+  boot_rww_enable();
+  sei();
+#   endif
+  pageCommitState = PAGECOMMIT_IDLE;
+#   if (HAVE_WRITEVERIFY)
+  writeVerifyPage(pageCommitAddr + 1);
+#   endif
+}
+
+static void pageCommitFinish(void) {
+  while (pageCommitState != PAGECOMMIT_IDLE) pageCommitPoll();
+}
+
+/* received packets are queued while the flash is busy */
+uchar usbRxQueueHold(void) {
+  pageCommitPoll();
+  return (pageCommitState != PAGECOMMIT_IDLE) || (boot_spm_busy());
+}
+#endif
+
+#if (HAVE_IMAGEAUTH)
+/* chain the collected block: XTEA with 32 cycles */
+static void imageAuthEncrypt(void) {
+  uint32_t v0  = imageAuthChain[0] ^ imageAuthBlock[0];
+  uint32_t v1  = imageAuthChain[1] ^ imageAuthBlock[1];
+  uint32_t sum = 0;
+  uchar    i;
+
+  for (i = 0; i < 32; i++) {
+    v0  += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + imageAuthKeyWord(sum & 3));
+    sum += 0x9e3779b9;
+    v1  += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + imageAuthKeyWord((sum >> 11) & 3));
+  }
+  imageAuthChain[0] = v0;
+  imageAuthChain[1] = v1;
+}
+
+static uchar imageAuthValid(void) {
+  return eeprom_read_byte((void *)(IMAGEAUTH_EEADDR)) == APPIMAGEAUTH_VALID;
+}
+
+/*
+ * An EEPROM write discards the flash page buffer: only call this while no
+ * page is being filled. Returns after the EEPROM write has completed, so
+ * the next SPM operation can not collide with it.
+ */
+static void imageAuthSetFlag(uchar value) {
+  if (eeprom_read_byte((void *)(IMAGEAUTH_EEADDR)) != value) {
+#   if (HAVE_RXQUEUE)
+    pageCommitFinish();		/* the last page may still be erased in background */
+#   endif
+    boot_spm_busy_wait();	/* no EEPROM write while SPM is active */
+    eeprom_write_byte((void *)(IMAGEAUTH_EEADDR), value);
+    eeprom_busy_wait();
+  }
+}
+
+/* length and expected MAC are known: MAC the prefix block */
+static void imageAuthStart(void) {
+  imageAuthChain[0] = 0;
+  imageAuthChain[1] = 0;
+  imageAuthBlock[0] = imageAuthLength;
+  imageAuthBlock[1] = APPIMAGEAUTH_MAGIC;
+  imageAuthEncrypt();
+  imageAuthCount = 0;
+  imageAuthState = IMAGEAUTH_ARMED;
+}
+
+/*
+ * called for every flash word filled (the flag has already been cleared when
+ * the write request came in). 0xff padding of the last page behind "length"
+ * (as avrdude sends it) is accepted and not part of the MAC.
+ */
+static void imageAuthUpdate(addr_t addr, uint16_t word) {
+  if (imageAuthState != IMAGEAUTH_ARMED) return;
+  if (imageAuthCount >= imageAuthLength) {
+    if ((word != 0xffff) || ((addr / SPM_PAGESIZE) != ((imageAuthLength - 1) / SPM_PAGESIZE)))
+      imageAuthState = IMAGEAUTH_FAILED;	/* data behind the image */
+    return;
+  }
+  if (addr != imageAuthCount) {
+    imageAuthState = IMAGEAUTH_FAILED;	/* not contiguous from address 0 */
+    return;
+  }
+  ((uint16_t *)imageAuthBlock)[(imageAuthCount >> 1) & 3] = word;
+  imageAuthCount += 2;
+  if (!(imageAuthCount & 7)) imageAuthEncrypt();
+}
+
+/* the last page has been written: pad the last block and compare */
+static void imageAuthFinish(void) {
+  if ((imageAuthState == IMAGEAUTH_ARMED) && (imageAuthCount == imageAuthLength)) {
+    if (imageAuthCount & 7) {
+      while (imageAuthCount & 7) {
+	((uint16_t *)imageAuthBlock)[(imageAuthCount >> 1) & 3] = 0xffff;
+	imageAuthCount += 2;
+      }
+      imageAuthEncrypt();
+    }
+    if ((imageAuthChain[0] == imageAuthExpected[0]) && (imageAuthChain[1] == imageAuthExpected[1]))
+      imageAuthSetFlag(APPIMAGEAUTH_VALID);
+  }
+  imageAuthState = IMAGEAUTH_OFF;
+}
+#endif
+
+#if (HAVE_STAGEDUPDATE)
+static uint16_t stagedUpdateCrc(addr_t addr, uint32_t n) {
+  uint16_t crc = 0xffff;
+
+  while (n--) {
+    wdt_reset();
+    crc = _crc16_update(crc, flashReadByte(addr++));
+  }
+  return crc;
+}
+
+/*
+ * Called at reset with interrupts still disabled: install a staged image
+ * if there is a valid one. Pages already equal to the staged ones are
+ * skipped, so a repeated (interrupted) copy only writes what is left.
+ * This runs before main() takes care of the watchdog, which the firmware
+ * may have left running (or WDTON enforces): keep resetting it, whatever
+ * NEED_WATCHDOG says, or the copy never completes.
+ */
+static void stagedUpdateCommit(void) {
+  appstage_t desc;
+  addr_t     dst;
+  uint       i;
+
+  for (i = 0; i < sizeof(appstage_t); i++) ((uchar *)&desc)[i] = flashReadByte(APPSTAGE_DESCRIPTOR + i);
+  if ((desc.magic != APPSTAGE_MAGIC) || (desc.length == 0) || (desc.length > APPSTAGE_BASE) ||
+      (desc.desccrc != stagedUpdateCrc(APPSTAGE_DESCRIPTOR, offsetof(appstage_t, desccrc))) ||
+      (desc.crc != stagedUpdateCrc(APPSTAGE_BASE, desc.length))) return;
+
+  DBG1(0x37, (void *)&desc.length, 4);
+  for (dst = 0; dst < desc.length; dst += SPM_PAGESIZE) {
+    for (i = 0; i < SPM_PAGESIZE; i++) {
+      if (flashReadByte(dst + i) != flashReadByte(APPSTAGE_BASE + dst + i)) break;
+    }
+    wdt_reset();
+    if (i == SPM_PAGESIZE) continue;	/* page already up to date */
+#   ifndef NO_FLASH_WRITE
+    for (i = 0; i < SPM_PAGESIZE; i += 2) {
+      boot_page_fill(dst + i, flashReadByte(APPSTAGE_BASE + dst + i) | (((uint16_t)flashReadByte(APPSTAGE_BASE + dst + i + 1)) << 8));
+    }
+    boot_page_erase(dst);
+#       if (HAVE_WEARLOG)
+    wearLogCount(dst);
+#       endif
+    boot_spm_busy_wait();
+    wdt_reset();
+    boot_page_write(dst);
+    boot_spm_busy_wait();
+    boot_rww_enable();
+#   endif
+  }
+  if (stagedUpdateCrc(0, desc.length) == desc.crc) {
+#   ifndef NO_FLASH_WRITE
+    boot_page_erase(APPSTAGE_DESCRIPTOR);	/* done - never copy again */
+#       if (HAVE_WEARLOG)
+    wearLogCount(APPSTAGE_DESCRIPTOR);
+#       endif
+    boot_spm_busy_wait();
+    boot_rww_enable();
+#   endif
+  }
+}
+#endif
+
+#if (HAVE_IDLESLEEP)
+/*
+ * Enter idle sleep if usbPoll() has nothing to do. The check is done with
+ * interrupts disabled and "sei" is immediately followed by "sleep", so an
+ * interrupt arriving in between cannot be missed: it will wake the CPU.
+ */
+static void idleSleep(void) {
+  cli();
+#if USB_CFG_TX_DOUBLEBUFFER
+  if ((usbRxLen <= 0) && (!((usbTxLenNext & 0x10) && (usbMsgLen != USB_NO_MSG)))
+#else
+  if ((usbRxLen <= 0) && (!((usbTxLen & 0x10) && (usbMsgLen != USB_NO_MSG)))
+#endif
+#   if (HAVE_RXQUEUE)
+      && (!usbRxQueueCount) && (pageCommitState == PAGECOMMIT_IDLE)
+#   endif
+     ) {
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+  }
+  sei();
+}
+#endif
+
 uchar usbFunctionSetup_USBASP_FUNC_TRANSMIT(usbRequest_t *rq) {
   uchar rval = 0;
   usbWord_t address;
@@ -376,12 +1296,14 @@ uchar usbFunctionSetup_USBASP_FUNC_TRANSMIT(usbRequest_t *rq) {
 #if defined (__AVR_ATmega8535__) || 					\
     defined (__AVR_ATmega8__) || defined (__AVR_ATmega8A__) || 		\
     defined (__AVR_ATmega16__) || defined (__AVR_ATmega32__)
-  }else if(rq->wValue.bytes[0] == 0x58 && rq->wValue.bytes[1] == 0x00){  /* read lock bits */
-      rval = boot_lock_fuse_bits_get(GET_LOCK_BITS);
-  }else if(rq->wValue.bytes[0] == 0x50 && rq->wValue.bytes[1] == 0x00){  /* read lfuse bits */
-      rval = boot_lock_fuse_bits_get(GET_LOW_FUSE_BITS);
-  }else if(rq->wValue.bytes[0] == 0x58 && rq->wValue.bytes[1] == 0x08){  /* read hfuse bits */
-      rval = boot_lock_fuse_bits_get(GET_HIGH_FUSE_BITS);
+  /*
+   * One lpm for all: lock (0x58 0x00), lfuse (0x50 0x00), hfuse (0x58 0x08)
+   * and efuse (0x50 0x08) map to GET_LOCK_BITS (1), GET_LOW_FUSE_BITS (0),
+   * GET_HIGH_FUSE_BITS (3) and GET_EXTENDED_FUSE_BITS (2)
+   */
+  }else if((((rq->wValue.bytes[0] & 0xf7) == 0x50) && (rq->wValue.bytes[1] == 0x00)) ||
+	   ((rq->wValue.bytes[0] == 0x58) && (rq->wValue.bytes[1] == 0x08))){  /* read lock, lfuse or hfuse bits */
+      rval = boot_lock_fuse_bits_get(((rq->wValue.bytes[0] >> 3) & 1) | ((rq->wValue.bytes[1] >> 2) & 2));
 
 #elif defined (__AVR_ATmega48__)   || defined (__AVR_ATmega48A__)   || defined (__AVR_ATmega48P__)   || defined (__AVR_ATmega48PA__)  ||  \
 defined (__AVR_ATmega88__)   || defined (__AVR_ATmega88A__)   || defined (__AVR_ATmega88P__)   || defined (__AVR_ATmega88PA__)  ||  \
@@ -398,45 +1320,61 @@ defined (__AVR_ATmega1281__) ||													\
 defined (__AVR_ATmega1284__) || defined (__AVR_ATmega1284P__)  ||													\
 defined (__AVR_ATmega2560__) ||													\
 defined (__AVR_ATmega2561__)
-  }else if(rq->wValue.bytes[0] == 0x58 && rq->wValue.bytes[1] == 0x00){  /* read lock bits */
-      rval = boot_lock_fuse_bits_get(GET_LOCK_BITS);
-  }else if(rq->wValue.bytes[0] == 0x50 && rq->wValue.bytes[1] == 0x00){  /* read lfuse bits */
-      rval = boot_lock_fuse_bits_get(GET_LOW_FUSE_BITS);
-  }else if(rq->wValue.bytes[0] == 0x58 && rq->wValue.bytes[1] == 0x08){  /* read hfuse bits */
-      rval = boot_lock_fuse_bits_get(GET_HIGH_FUSE_BITS);
-  }else if(rq->wValue.bytes[0] == 0x50 && rq->wValue.bytes[1] == 0x08){  /* read efuse bits */
-      rval = boot_lock_fuse_bits_get(GET_EXTENDED_FUSE_BITS );
+  }else if(((rq->wValue.bytes[0] & 0xf7) == 0x50) && ((rq->wValue.bytes[1] & 0xf7) == 0x00)){  /* read lock, lfuse, hfuse or efuse bits */
+      rval = boot_lock_fuse_bits_get(((rq->wValue.bytes[0] >> 3) & 1) | ((rq->wValue.bytes[1] >> 2) & 2));
 #else
   #warning "HAVE_READ_LOCK_FUSE is activated but MCU unknown -> will not support this feature"
 #endif
 #endif
 #if HAVE_FLASH_BYTE_READACCESS
   }else if(rq->wValue.bytes[0] == 0x20){  /* read FLASH low  byte */
-#if ((FLASHEND) > 65535)
-      rval = pgm_read_byte_far((((addr_t)address.word)<<1)+0);
-#else
-      rval = pgm_read_byte((((addr_t)address.word)<<1)+0);
+#if HAVE_ERASEAHEAD
+      eraseAheadRwwSync();
 #endif
+      rval = flashReadByteHost((((addr_t)address.word)<<1)+0);
   }else if(rq->wValue.bytes[0] == 0x28){  /* read FLASH high byte */
-#if ((FLASHEND) > 65535)
-      rval = pgm_read_byte_far((((addr_t)address.word)<<1)+1);
-#else
-      rval = pgm_read_byte((((addr_t)address.word)<<1)+1);
+#if HAVE_ERASEAHEAD
+      eraseAheadRwwSync();
 #endif
+      rval = flashReadByteHost((((addr_t)address.word)<<1)+1);
 #endif
 #if HAVE_EEPROM_BYTE_ACCESS
   }else if(rq->wValue.bytes[0] == 0xa0){  /* read EEPROM byte */
       rval = eeprom_read_byte((void *)address.word);
   }else if(rq->wValue.bytes[0] == 0xc0){  /* write EEPROM byte */
+#if HAVE_ERASEAHEAD
+      boot_spm_busy_wait();   /* no EEPROM write while SPM is active */
+#endif
+#if (HAVE_RXQUEUE)
+      pageCommitFinish();     /* no EEPROM write between erase and write of a page */
+#endif
+#if (HAVE_IMAGEAUTH)
+      if (address.word != (IMAGEAUTH_EEADDR))	/* the authentication flag is not writable by the host */
+#endif
       eeprom_write_byte((void *)address.word, rq->wIndex.bytes[1]);
 #endif
 #if HAVE_CHIP_ERASE
   }else if(rq->wValue.bytes[0] == 0xac && rq->wValue.bytes[1] == 0x80){  /* chip erase */
       addr_t addr;
+#if (HAVE_APPMANIFEST_BOUNDEDERASE)
+      uchar  bounded = appManifestLoad();
+#endif
+#if (HAVE_RXQUEUE)
+      pageCommitFinish();
+#endif
+#if (HAVE_IMAGEAUTH)
+      imageAuthSetFlag(0);
+#endif
 #if HAVE_BLB11_SOFTW_LOCKBIT
       for(addr = 0; addr < (addr_t)(BOOTLOADER_PAGEADDR) ; addr += SPM_PAGESIZE) {
 #else
       for(addr = 0; addr <= (addr_t)(FLASHEND) ; addr += SPM_PAGESIZE) {
+#endif
+#if (HAVE_APPSLOTS)
+	  if ((appSlotOf(addr) == APPSLOT_NONE) || (appSlotOf(addr) == appSlotActive)) continue;
+#endif
+#if (HAVE_APPMANIFEST_BOUNDEDERASE)
+	  if ((bounded) && (!appManifestPageUsed(addr))) continue;
 #endif
 	  /* wait and erase page */
 	  DBG1(0x33, 0, 0);
@@ -445,6 +1383,9 @@ defined (__AVR_ATmega2561__)
 	  cli();
 	  boot_page_erase(addr);
 	  sei();
+#       if (HAVE_WEARLOG)
+	  wearLogCount(addr);
+#       endif
 #   endif
       }
 #endif
@@ -496,13 +1437,122 @@ static uchar    replyBuffer[4];
             bytesRemaining = rq->wLength.bytes[0];
             /* if(rq->bRequest == USBASP_FUNC_WRITEFLASH) only evaluated during writeFlash anyway */
             isLastPage = rq->wIndex.bytes[1] & 0x02;
-#if HAVE_EEPROM_PAGED_ACCESS
+#if HAVE_CURRENTREQUEST
             currentRequest = rq->bRequest;
+#endif
+#if (HAVE_IMAGEAUTH)
+            /* any flash write invalidates the image - before the first page fill */
+            if(rq->bRequest == USBASP_FUNC_WRITEFLASH) imageAuthSetFlag(0);
 #endif
             len = USB_NO_MSG; /* hand over to usbFunctionRead() / usbFunctionWrite() */
         }
+#if (HAVE_EXTENDEDADDRESS)
+    }else if((rq->bRequest == USBASPLOADER_FUNC_READFLASHEX) || (rq->bRequest == USBASPLOADER_FUNC_WRITEFLASHEX)){
+        if(!(rq->wIndex.bytes[1] & USBASPLOADER_EXFLAG_AUTOINC)){
+            currentAddress.w[0] = rq->wValue.word;
+            currentAddress.w[1] = rq->wIndex.bytes[0];
+        }
+        bytesRemaining = rq->wLength.bytes[0];
+        isLastPage = rq->wIndex.bytes[1] & USBASPLOADER_EXFLAG_LASTPAGE;
+#   if HAVE_CURRENTREQUEST
+        /* from here on handled exactly like the classic requests */
+        currentRequest = (rq->bRequest == USBASPLOADER_FUNC_READFLASHEX) ? USBASP_FUNC_READFLASH : USBASP_FUNC_WRITEFLASH;
+#   endif
+#   if (HAVE_IMAGEAUTH)
+        if(rq->bRequest == USBASPLOADER_FUNC_WRITEFLASHEX) imageAuthSetFlag(0);
+#   endif
+        len = USB_NO_MSG;
+#endif
 
+#if (HAVE_BOOTLOADER_AUTOSTART)
+    }else if(rq->bRequest == USBASPLOADER_FUNC_SETIMAGECRC){
+        /* wValue: CRC16 of all flash data the host is going to write next */
+        imageCrcExpected = rq->wValue.word;
+        imageCrc         = 0xffff;
+        autoStartState   = AUTOSTART_ARMED;
+#endif
+#if (HAVE_APPSLOTS)
+    }else if(rq->bRequest == USBASPLOADER_FUNC_SLOTINFO){
+        /* wValue: slot to describe */
+        appSlotInfo.slot   = rq->wValue.bytes[0] & 1;
+        appSlotInfo.active = appSlotActive;
+        appSlotInfo.pages  = APPSLOT_SIZE / SPM_PAGESIZE;
+        appSlotInfo.base   = APPSLOT_BASE(appSlotInfo.slot);
+        appSlotReadHeader(appSlotInfo.slot, &appSlotInfo.header);
+        usbMsgPtr = (usbMsgPtr_t)&appSlotInfo;
+        len = sizeof(appslotinfo_t);
+    }else if(rq->bRequest == USBASPLOADER_FUNC_SLOTCOMMIT){
+        /* wValue: slot, OUT data: appslotcommit_t */
+        if (rq->wLength.word == sizeof(appslotcommit_t)) {
+            bytesRemaining    = sizeof(appslotcommit_t);
+            currentRequest    = rq->bRequest;
+            appSlotCommitSlot = rq->wValue.bytes[0];
+            len = USB_NO_MSG;
+        }
+    }else if(rq->bRequest == USBASPLOADER_FUNC_SLOTSELECT){
+        /* wValue: slot, reply: 0 on success */
+        replyBuffer[0] = appSlotSelect(rq->wValue.bytes[0]) ? 0 : 1;
+        len = (usbMsgLen_t)1;
+#endif
+#if (HAVE_APPMANIFEST)
+    }else if(rq->bRequest == USBASPLOADER_FUNC_IMAGECRC){
+        appImageCrcUpdate();
+        usbMsgPtr = (usbMsgPtr_t)&appImageCrc;
+        len = sizeof(appimagecrc_t);
+    }else if(rq->bRequest == USBASPLOADER_FUNC_MANIFEST){
+        usbMsgPtr = (usbMsgPtr_t)&appManifest;
+        len = appManifestLoad() ? sizeof(appmanifest_t) : 0;
+#endif
+#if (HAVE_WRITEVERIFY)
+    }else if(rq->bRequest == USBASPLOADER_FUNC_VERIFYRESULT){
+        /* bit set: page failed verification since USBASP_FUNC_CONNECT */
+        usbMsgPtr = (usbMsgPtr_t)writeVerifyFailMap;
+        len = sizeof(writeVerifyFailMap);
+#endif
+#if (HAVE_RXCRCCHECK)
+    }else if(rq->bRequest == USBASPLOADER_FUNC_RXCRCRESULT){
+        /* bit set: page received damaged data and has not been written since */
+        usbMsgPtr = (usbMsgPtr_t)rxCrcFailMap;
+        len = sizeof(rxCrcFailMap);
+#endif
+#if (HAVE_IMAGEAUTH)
+    }else if(rq->bRequest == USBASPLOADER_FUNC_IMAGEAUTH){
+        /* wValue: image length low, wIndex: image length high, OUT data: 8 bytes MAC */
+        if (rq->wLength.word == sizeof(imageAuthExpected)) {
+            imageAuthLength = ((uint32_t)rq->wIndex.word << 16) | rq->wValue.word;
+            bytesRemaining  = sizeof(imageAuthExpected);
+            currentRequest  = rq->bRequest;
+            len = USB_NO_MSG;
+        }
+#endif
+#if (HAVE_WEARLOG)
+    }else if(rq->bRequest == USBASPLOADER_FUNC_WEARLOGINFO){
+        usbMsgPtr = (usbMsgPtr_t)&wearLogInfo;
+        len = sizeof(appwearloginfo_t);
+    }else if(rq->bRequest == USBASPLOADER_FUNC_WEARLOG){
+        /* wValue: first counter, IN data: counters as stored in EEPROM (without pending erases) */
+        if (rq->wValue.word < WEARLOG_ENTRIES) {
+            uint n = 2 * (WEARLOG_ENTRIES - rq->wValue.word);
+
+            if (n > rq->wLength.word) n = rq->wLength.word;
+            currentAddress.w[0] = WEARLOG_EEADDR + (2 * rq->wValue.word);
+            bytesRemaining = (n > 0xfe) ? 0xfe : n;
+            currentRequest = USBASP_FUNC_READEEPROM;	/* served by usbFunctionRead() */
+            len = USB_NO_MSG;
+        }
+#endif
+#if HAVE_ERASEAHEAD
+    }else if(rq->bRequest == USBASPLOADER_FUNC_ERASEAHEAD){
+        /* wValue: first page, wIndex: number of pages to be written next */
+        eraseAheadNext = rq->wValue.word;
+        eraseAheadEnd  = rq->wValue.word + rq->wIndex.word;
+        if ((eraseAheadEnd > APPLICATION_PAGECOUNT) || (eraseAheadEnd < eraseAheadNext))
+            eraseAheadEnd = APPLICATION_PAGECOUNT;
+#endif
     }else if(rq->bRequest == USBASP_FUNC_DISCONNECT){
+#if (HAVE_WEARLOG)
+      wearLogFlushNext = 0;	/* session end: update the wear log in background */
+#endif
 
 #if BOOTLOADER_CAN_EXIT
 #	ifdef CONFIG_HAVE__BOOTLOADER_ABORTTIMEOUTONACT
@@ -514,6 +1564,23 @@ static uchar    replyBuffer[4];
 #endif
     }else{
         /* ignore: others, but could be USBASP_FUNC_CONNECT */
+#if (HAVE_WRITEVERIFY)
+        if(rq->bRequest == USBASP_FUNC_CONNECT){
+            memset(writeVerifyFailMap, 0, sizeof(writeVerifyFailMap));
+            writeVerifyCrc   = 0;
+            writeVerifyCount = 0;
+        }
+#endif
+#if (HAVE_RXCRCCHECK)
+        if(rq->bRequest == USBASP_FUNC_CONNECT){
+            memset(rxCrcFailMap, 0, sizeof(rxCrcFailMap));
+        }
+#endif
+#if (HAVE_WEARLOG)
+        if(rq->bRequest == USBASP_FUNC_CONNECT){
+            wearLogFlushNext = WEARLOG_ENTRIES;	/* keep the rest pending until session end */
+        }
+#endif
 #if BOOTLOADER_CAN_EXIT
 	stayinloader	   |= (0x01);
 #endif
@@ -521,7 +1588,11 @@ static uchar    replyBuffer[4];
     return len;
 }
 
-#if (USE_EXCESSIVE_ASSEMBLER) && ((!HAVE_CHIP_ERASE) || (HAVE_ONDEMAND_PAGEERASE)) && (SPM_PAGESIZE <= 256) && (((BOOTLOADER_PAGEADDR>>0)&0xff) == 0)
+/* the hand-optimized usbFunctionWrite() only implements the basic write path */
+#define USE_ASM_USBFUNCTIONWRITE	((USE_EXCESSIVE_ASSEMBLER) && ((!HAVE_CHIP_ERASE) || (HAVE_ONDEMAND_PAGEERASE)) && (SPM_PAGESIZE <= 256) && (((BOOTLOADER_PAGEADDR>>0)&0xff) == 0) && \
+					 (!(HAVE_ERASEAHEAD)) && (!(HAVE_BOOTLOADER_AUTOSTART)) && (!(HAVE_APPSLOTS)) && (!(HAVE_WRITEVERIFY)) && (!(HAVE_RXCRCCHECK)) && (!(HAVE_IMAGEAUTH)) && (!(HAVE_WEARLOG)) && (!(HAVE_RXQUEUE)))
+
+#if (USE_ASM_USBFUNCTIONWRITE)
 uchar usbFunctionWrite(uchar *data, uchar len)
 {
 uchar   isLast;
@@ -643,8 +1714,34 @@ uchar   i,isLast;
         len = bytesRemaining;
     bytesRemaining -= len;
     isLast = bytesRemaining == 0;
+#if (HAVE_APPSLOTS)
+    if (currentRequest == USBASPLOADER_FUNC_SLOTCOMMIT) {
+	memcpy(((uchar *)&appSlotCommitData) + (sizeof(appslotcommit_t) - (bytesRemaining + len)), data, len);
+	if (isLast) return appSlotCommit(appSlotCommitSlot) ? 1 : 0xff;
+	return 0;
+    }
+#endif
+#if (HAVE_IMAGEAUTH)
+    if (currentRequest == USBASPLOADER_FUNC_IMAGEAUTH) {
+	memcpy(((uchar *)imageAuthExpected) + (sizeof(imageAuthExpected) - (bytesRemaining + len)), data, len);
+	if (isLast) imageAuthStart();
+	return isLast;
+    }
+#endif
     for(i = 0; i < len;) {
       if(currentRequest >= USBASP_FUNC_READEEPROM){
+#if HAVE_ERASEAHEAD
+	boot_spm_busy_wait();	/* no EEPROM write while SPM is active */
+#endif
+#if (HAVE_RXQUEUE)
+	pageCommitFinish();	/* no EEPROM write between erase and write of a page */
+#endif
+#if (HAVE_IMAGEAUTH)
+	if (currentAddress.w[0] == (IMAGEAUTH_EEADDR)) {
+	  currentAddress.w[0]++;	/* the authentication flag is not writable by the host */
+	  data++;
+	} else
+#endif
 	eeprom_write_byte((void *)(currentAddress.w[0]++), *data++);
 	i++;
       } else {
@@ -652,24 +1749,92 @@ uchar   i,isLast;
 	if (CURRENT_ADDRESS >= (addr_t)(BOOTLOADER_PAGEADDR)) {
 	  return 1;
 	}
+#endif
+#if (HAVE_APPSLOTS)
+	if (!appSlotWritable(CURRENT_ADDRESS)) {
+	  return 0xff;	/* STALL: outside an inactive slot image */
+	}
 #endif
 	i += 2;
 	DBG1(0x32, 0, 0);
+#if (HAVE_RXCRCCHECK)
+	if ((CURRENT_ADDRESS / SPM_PAGESIZE) < APPLICATION_PAGECOUNT) {
+	  if ((currentAddress.w[0] & (SPM_PAGESIZE - 1)) == 0)
+	    pageBitmapClear(rxCrcFailMap, CURRENT_ADDRESS / SPM_PAGESIZE);	/* page (re)started */
+	  if (usbRxCrcError)
+	    pageBitmapSet(rxCrcFailMap, CURRENT_ADDRESS / SPM_PAGESIZE);
+	}
+	if (!usbRxCrcError)
+#endif
+	{
+#if HAVE_ERASEAHEAD
+	boot_spm_busy_wait();	/* a background erase may still be running */
+#endif
 	cli();
 	boot_page_fill(CURRENT_ADDRESS, *(short *)data);
 	sei();
+	}
+#if (HAVE_BOOTLOADER_AUTOSTART)
+	imageCrc = _crc16_update(_crc16_update(imageCrc, data[0]), data[1]);
+#endif
+#if (HAVE_IMAGEAUTH)
+	imageAuthUpdate(CURRENT_ADDRESS, *(uint16_t *)data);
+#endif
+#if (HAVE_WRITEVERIFY)
+	writeVerifyCrc = _crc16_update(_crc16_update(writeVerifyCrc, data[0]), data[1]);
+	writeVerifyCount += 2;
+#endif
 	CURRENT_ADDRESS += 2;
 	data += 2;
 	/* write page when we cross page boundary or we have the last partial page */
 	if((currentAddress.w[0] & (SPM_PAGESIZE - 1)) == 0 || (isLast && i >= len && isLastPage)){
+#if (HAVE_RXCRCCHECK)
+	  if (((CURRENT_ADDRESS - 2) / SPM_PAGESIZE) < APPLICATION_PAGECOUNT) {
+	    if (pageBitmapTest(rxCrcFailMap, (CURRENT_ADDRESS - 2) / SPM_PAGESIZE)) {
+	      /* leave the page untouched until the host resends it, just drop the page buffer */
+	      boot_spm_busy_wait();
+	      cli();
+	      boot_rww_enable();
+	      sei();
+#   if (HAVE_WRITEVERIFY)
+	      writeVerifyCrc   = 0;
+	      writeVerifyCount = 0;
+#   endif
+	      continue;
+	    }
+	  }
+#endif
+#if (HAVE_RXQUEUE)
+	  {
+#   if (!HAVE_CHIP_ERASE) || (HAVE_ONDEMAND_PAGEERASE)
+#       if HAVE_ERASEAHEAD
+	    uchar erase = !eraseAheadClaim(CURRENT_ADDRESS - 2);
+#       else
+	    uchar erase = 1;
+#       endif
+#   else
+	    uchar erase = 0;
+#   endif
+	    pageCommitStart(CURRENT_ADDRESS - 2, erase);
+	    if (i < len) pageCommitFinish();	/* the rest of this packet goes to the next page */
+	  }
+#else
 #if (!HAVE_CHIP_ERASE) || (HAVE_ONDEMAND_PAGEERASE)
+#   if HAVE_ERASEAHEAD
+	  if (!eraseAheadClaim(CURRENT_ADDRESS - 2))	/* already erased in background? */
+#   endif
+	  {
 	    DBG1(0x33, 0, 0);
 #   ifndef NO_FLASH_WRITE
 	    cli();
 	    boot_page_erase(CURRENT_ADDRESS - 2);   /* erase page */
 	    sei();
+#       if (HAVE_WEARLOG)
+	    wearLogCount(CURRENT_ADDRESS - 2);
+#       endif
 	    boot_spm_busy_wait();                   /* wait until page is erased */
 #   endif
+	  }
 #endif
 	    DBG1(0x34, 0, 0);
 #ifndef NO_FLASH_WRITE
@@ -680,15 +1845,33 @@ uchar   i,isLast;
 	    cli();
 	    boot_rww_enable();
 	    sei();
+#endif
+#if (HAVE_WRITEVERIFY)
+	    writeVerifyPage(CURRENT_ADDRESS - 1);
+#endif
 #endif
 	}
         }
         DBG1(0x35, (void *)&currentAddress.l, 4);
     }
+#if (HAVE_BOOTLOADER_AUTOSTART)
+    if (isLast && isLastPage && (currentRequest < USBASP_FUNC_READEEPROM) && (autoStartState == AUTOSTART_ARMED)) {
+	autoStartState = (imageCrc == imageCrcExpected) ? AUTOSTART_VERIFIED : AUTOSTART_OFF;
+    }
+#endif
+#if (HAVE_IMAGEAUTH)
+    if (isLast && isLastPage && (currentRequest < USBASP_FUNC_READEEPROM)) {
+	imageAuthFinish();
+    }
+#endif
     return isLast;
 }
 #endif
 
+#ifndef EEWE	/* newer MCUs call it EEPE */
+#   define EEWE	EEPE
+#endif
+
 uchar usbFunctionRead(uchar *data, uchar len)
 {
 uchar   i;
@@ -696,18 +1879,58 @@ uchar   i;
     if(len > bytesRemaining)
         len = bytesRemaining;
     bytesRemaining -= len;
-    for(i = 0; i < len; i++){
-        if(currentRequest >= USBASP_FUNC_READEEPROM){
-            *data = eeprom_read_byte((void *)currentAddress.w[0]);
-        }else{
-#if ((FLASHEND) > 65535)
-            *data = pgm_read_byte_far(CURRENT_ADDRESS);
+    if(currentRequest >= USBASP_FUNC_READEEPROM){
+        /* burst read: wait for a pending write only once, then strobe EERE per byte */
+        i = len;
+#if USE_EXCESSIVE_ASSEMBLER
+asm  volatile  (
+"usbFunctionRead_eewait:\n\t"
+  "sbic		%[eecr],	%[eewe]\n\t"
+  "rjmp		usbFunctionRead_eewait\n\t"
+  "tst		%[cnt]\n\t"
+  "breq		usbFunctionRead_eedone\n\t"
+"usbFunctionRead_eeloop:\n\t"
+#   ifdef EEARH
+  "out		%[eearh],	%B[addr]\n\t"
+#   endif
+  "out		%[eearl],	%A[addr]\n\t"
+  "sbi		%[eecr],	%[eere]\n\t"
+  "in		__tmp_reg__,	%[eedr]\n\t"
+  "st		%a[ptr]+,	__tmp_reg__\n\t"
+  "adiw		%[addr],	1\n\t"
+  "dec		%[cnt]\n\t"
+  "brne		usbFunctionRead_eeloop\n\t"
+"usbFunctionRead_eedone:\n\t"
+  : [addr]        "+w" (currentAddress.w[0]),
+    [ptr]         "+e" (data),
+    [cnt]         "+r" (i)
+  : [eecr]        "I"  (_SFR_IO_ADDR(EECR)),
+    [eedr]        "I"  (_SFR_IO_ADDR(EEDR)),
+    [eearl]       "I"  (_SFR_IO_ADDR(EEARL)),
+#   ifdef EEARH
+    [eearh]       "I"  (_SFR_IO_ADDR(EEARH)),
+#   endif
+    [eewe]        "I"  (EEWE),
+    [eere]        "I"  (EERE)
+  : "memory"
+);
 #else
-            *data = pgm_read_byte(CURRENT_ADDRESS);
+        while (EECR & (1<<EEWE));
+        for(; i; i--){
+            EEAR = currentAddress.w[0]++;
+            EECR |= (1<<EERE);
+            *data++ = EEDR;
+        }
+#endif
+    }else{
+        for(i = 0; i < len; i++){
+#if HAVE_ERASEAHEAD
+            eraseAheadRwwSync();
 #endif
+            *data = flashReadByteHost(CURRENT_ADDRESS);
+            data++;
+            CURRENT_ADDRESS++;
         }
-        data++;
-        CURRENT_ADDRESS++;
     }
     return len;
 }
@@ -757,18 +1980,38 @@ static void __DO_NOT_USE_DIRECTLY_mywait(uint8_t waitloopcnt, uint16_t remainder
 static void initForUsbConnectivity(void)
 {
     usbInit();
+#if (HAVE_USBHANDOFF)
+    if (usbHandoffValid()) {
+      /* the firmware's V-USB left us enumerated: just continue on its address
+       * (the mailbox holds the plain address, "usbDeviceAddr" is compared shifted) */
+      usbNewDeviceAddr = __USBHANDOFF__bootup_mailbox.deviceaddr;
+      usbDeviceAddr    = __USBHANDOFF__bootup_mailbox.deviceaddr << 1;
+      usbConfiguration = __USBHANDOFF__bootup_mailbox.configuration;
+      /* the reset tri-stated a port controlled pull-up: attach again at once
+       * (if the host noticed, its bus reset falls back to a new enumeration) */
+      usbDeviceConnect();
+    } else
+#endif
+    {
     /* enforce USB re-enumerate: */
     usbDeviceDisconnect();  /* do this while interrupts are disabled */
     _mydelay_ms(250);	/* fake USB disconnect for > 250 ms */
     usbDeviceConnect();
+    }
     sei();
 }
 
 int __attribute__((__noreturn__)) main(void)
 {
-#if ((BOOTLOADER_LOOPCYCLES_TIMEOUT) && (BOOTLOADER_CAN_EXIT))
+#if ((BOOTLOADER_MSTIMEOUT) && (BOOTLOADER_CAN_EXIT))
+    uint16_t __lasttick = 0;
+    timeout_remaining = BOOTLOADER_TIMER_TICKS(BOOTLOADER_MSTIMEOUT);
+#elif ((BOOTLOADER_LOOPCYCLES_TIMEOUT) && (BOOTLOADER_CAN_EXIT))
     uint16_t __loopscycles;
     timeout_remaining = BOOTLOADER_LOOPCYCLES_TIMEOUT;
+#endif
+#if ((BOOTLOADER_MSDEBOUNCE) && (BOOTLOADER_CAN_EXIT) && (!(BOOTLOADER_IGNOREPROGBUTTON)))
+    uint16_t __lastsample = 0;
 #endif
     /* initialize  */
     bootLoaderInit();
@@ -781,12 +2024,22 @@ int __attribute__((__noreturn__)) main(void)
 #if (HAVE_BOOTLOADER_ADDITIONALMSDEVICEWAIT>0)
     _mydelay_ms(HAVE_BOOTLOADER_ADDITIONALMSDEVICEWAIT);
 #endif
+#if (HAVE_STAGEDUPDATE)
+    stagedUpdateCommit();
+#   if (HAVE_WEARLOG)
+    wearLogFlush();
+#   endif
+#endif
+#if (HAVE_IMAGEAUTH)
+    if((bootLoaderCondition()) || (!imageAuthValid())){
+#else
     if(bootLoaderCondition()){
+#endif
 #if (BOOTLOADER_CAN_EXIT)
 #	if (USE_EXCESSIVE_ASSEMBLER)
 asm  volatile  (
   "ldi		%[sil],		%[normval]\n\t"
-#		if ((defined(CONFIG_HAVE__BOOTLOADER_ABORTTIMEOUTONACT)) && (!(BOOTLOADER_IGNOREPROGBUTTON)) && (BOOTLOADER_LOOPCYCLES_TIMEOUT))
+#		if ((defined(CONFIG_HAVE__BOOTLOADER_ABORTTIMEOUTONACT)) && (!(BOOTLOADER_IGNOREPROGBUTTON)) && (BOOTLOADER_HAVE_TIMEOUT))
   "sbis		%[pin],		%[bit]\n\t"
   "subi		%[sil],		0x02\n\t"
 #		endif
@@ -799,7 +2052,7 @@ asm  volatile  (
 #		endif    
 );
 #	else
-#		if ((defined(CONFIG_HAVE__BOOTLOADER_ABORTTIMEOUTONACT)) && (!(BOOTLOADER_IGNOREPROGBUTTON)) && (BOOTLOADER_LOOPCYCLES_TIMEOUT))
+#		if ((defined(CONFIG_HAVE__BOOTLOADER_ABORTTIMEOUTONACT)) && (!(BOOTLOADER_IGNOREPROGBUTTON)) && (BOOTLOADER_HAVE_TIMEOUT))
       if (bootLoaderConditionSimple()) {
 	stayinloader = stayinloader_initialValue - 0x02;
       } else
@@ -817,10 +2070,40 @@ asm  volatile  (
 #	if ((NEED_WATCHDOG) || (defined(__MCUCSR_COMPATMODE)))
 	wdt_disable();    /* main app may have enabled watchdog */
 #	endif
+#endif
+#if (HAVE_APPSLOTS)
+        appSlotActive = appSlotFindActive();
 #endif
         initForUsbConnectivity();
+#if (HAVE_IDLESLEEP)
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        IDLESLEEP_TCCR0 = IDLESLEEP_PRESCALER;
+        IDLESLEEP_TIMSK |= (1 << TOIE0);
+#endif
+#if (HAVE_BOOTLOADER_TIMER)
+        TCCR1A = 0;
+        TCNT1  = 0;
+        TCCR1B = (1 << CS11) | (1 << CS10);	/* free running at F_CPU/64 */
+#endif
         do{
-#if ((BOOTLOADER_LOOPCYCLES_TIMEOUT) && (BOOTLOADER_CAN_EXIT))
+#if ((BOOTLOADER_MSTIMEOUT) && (BOOTLOADER_CAN_EXIT))
+	{
+	  uint16_t __now     = TCNT1;
+	  uint16_t __elapsed = __now - __lasttick;
+	  __lasttick = __now;
+#	ifdef CONFIG_HAVE__BOOTLOADER_ABORTTIMEOUTONACT
+	  if (stayinloader != 0x0e) {
+#	else
+	  if (stayinloader & 0x01) {
+#	endif
+	    timeout_remaining = BOOTLOADER_TIMER_TICKS(BOOTLOADER_MSTIMEOUT);
+	  } else if (timeout_remaining > __elapsed) {
+	    timeout_remaining -= __elapsed;
+	  } else {
+	    stayinloader&=0xf1;
+	  }
+	}
+#elif ((BOOTLOADER_LOOPCYCLES_TIMEOUT) && (BOOTLOADER_CAN_EXIT))
 #	ifdef CONFIG_HAVE__BOOTLOADER_ABORTTIMEOUTONACT
 	if (stayinloader != 0x0e) {
 	  /* can be reached, since high-nibble is decreased every cycle... */
@@ -840,6 +2123,19 @@ asm  volatile  (
 	    wdt_reset();
 #endif
             usbPoll();
+            odDebugPoll();
+#if (HAVE_RXQUEUE)
+            pageCommitPoll();
+#endif
+#if HAVE_ERASEAHEAD
+            eraseAheadPoll();
+#endif
+#if (HAVE_WEARLOG)
+            wearLogPoll();
+#endif
+#if (HAVE_IDLESLEEP)
+            idleSleep();
+#endif
 #if BOOTLOADER_CAN_EXIT
 #if BOOTLOADER_IGNOREPROGBUTTON
   /* 
@@ -856,6 +2152,10 @@ asm  volatile  (
   stayinloader &= 0x0f;
 #endif
 #else
+#if (BOOTLOADER_MSDEBOUNCE)
+	if ((uint16_t)(TCNT1 - __lastsample) >= (uint16_t)BOOTLOADER_TIMER_TICKS(BOOTLOADER_MSDEBOUNCE)) {
+	  __lastsample = TCNT1;
+#endif
 #if USE_EXCESSIVE_ASSEMBLER
 asm  volatile  (
   "cpi		%[sil],		0x10\n\t"
@@ -886,15 +2186,42 @@ asm  volatile  (
 	  }
 	}
 #endif
+#if (BOOTLOADER_MSDEBOUNCE)
+	}
+#endif
 #endif
 #endif
 
+#if (HAVE_BOOTLOADER_AUTOSTART)
+	/* leave as soon as the status stage of the last write has been sent */
+	if ((autoStartState == AUTOSTART_VERIFIED) && (usbTxLen & 0x10) && (usbMsgLen == USB_NO_MSG))
+	  stayinloader = 0;
+#endif
+
+#if ((HAVE_IMAGEAUTH) && (BOOTLOADER_CAN_EXIT))
+	/* never start a firmware which has not been authenticated */
+	if ((!stayinloader) && (!imageAuthValid()))
+	  stayinloader = stayinloader_initialValue;
+#endif
+
 #if BOOTLOADER_CAN_EXIT
         }while (stayinloader);	/* main event loop, if BOOTLOADER_CAN_EXIT*/
 #else
         }while (1);  		/* main event loop */
+#endif
+#if (HAVE_RXQUEUE)
+        pageCommitFinish();
+#endif
+#if (HAVE_WEARLOG)
+        wearLogFlush();
+#endif
+#if HAVE_ERASEAHEAD
+        eraseAheadRwwSync();	/* never start the firmware from a busy RWW section */
 #endif
     }
+#if (HAVE_APPSLOTS)
+    appSlotPrepareStart();
+#endif
     leaveBootloader();
 }
 
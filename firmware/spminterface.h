@@ -102,8 +102,10 @@ ret
  * This is necessary to always locate the
  * "bootloader__do_spm" for example at 0x1826, even if
  * there are existing PROGMEM within the firmware...
+ * ("used" keeps link time optimization from dropping it,
+ * since nothing within the bootloader references it.)
  */
-#define BOOTLIBLINK __attribute__ ((section (".vectors") ))
+#define BOOTLIBLINK __attribute__ ((section (".vectors"), used ))
 
 
 #ifndef funcaddr___bootloader__do_spm
@@ -425,6 +427,41 @@ ret
 void do_spm(const uint32_t flash_byteaddress, const uint8_t spmcrval, const uint16_t dataword) {
     __do_spm_Ex(flash_byteaddress, spmcrval, dataword, funcaddr___bootloader__do_spm >> 1);
 }
+
+#if HAVE_BOOTSERVICES
+#if defined (__AVR_ATmega128__)
+  #define funcaddr___bootloader__services (funcaddr___bootloader__do_spm + ((HAVE_SPMINTEREFACE_MAGICVALUE)?(2*28):(2*20)))
+#else
+  #define funcaddr___bootloader__services (funcaddr___bootloader__do_spm + ((HAVE_SPMINTEREFACE_MAGICVALUE)?(2*24):(2*16)))
+#endif
+
+/* check "pgm_read_word_far(funcaddr___bootloader__services)" against BOOTLOADER__SERVICES_MAGIC before use */
+uint16_t bootloader__crc16_far(const uint32_t flash_byteaddress, const uint16_t length, const uint16_t crc) {
+  register uint32_t r22 asm("r22") = flash_byteaddress;
+  register uint16_t r20 asm("r20") = length;
+  register uint16_t r18 asm("r18") = crc;
+  asm volatile (
+    "call %[servicefunc]\n\t"
+    : "+r" (r22), "+r" (r20), "+r" (r18)
+    : [servicefunc] "i" (funcaddr___bootloader__services + 4)
+    : "r0", "r30", "r31", "memory"
+  );
+  return (uint16_t)(r22 >> 16);
+}
+
+void *bootloader__memcpy_far(void *dest, const uint32_t flash_byteaddress, const uint16_t length) {
+  register void *r24 asm("r24") = dest;
+  register uint32_t r20 asm("r20") = flash_byteaddress;
+  register uint16_t r18 asm("r18") = length;
+  asm volatile (
+    "call %[servicefunc]\n\t"
+    : "+r" (r24), "+r" (r20), "+r" (r18)
+    : [servicefunc] "i" (funcaddr___bootloader__services + 6)
+    : "r0", "r26", "r27", "r30", "r31", "memory"
+  );
+  return r24;
+}
+#endif
 #endif
 
 #if HAVE_SPMINTEREFACE_NORETMAGIC
@@ -433,6 +470,103 @@ void do_spm(const uint32_t flash_byteaddress, const uint8_t spmcrval, const uint
   #define bootloader__do_spm_magic_exitstrategy(a) (a)
 #endif
 
+#if HAVE_BOOTSERVICES
+/*
+ * With HAVE_BOOTSERVICES a table of services directly follows the code of
+ * "bootloader__do_spm" (MCUs with rampZ only): one magic word, one word
+ * with version (low byte) and number of services (high byte) and then one
+ * "rjmp" per service. Services follow the avr-gcc calling convention,
+ * change r0, r18..r21 and Z (memcpy also X) and return with rampZ zero:
+ *
+ *   table+4: uint16_t crc16(uint32_t flash_byteaddress, uint16_t length, uint16_t crc)
+ *   table+6: void *memcpy(void *dest, uint32_t flash_byteaddress, uint16_t length)
+ *
+ * "crc16" equals "_crc16_update()" applied to every byte in the range.
+ */
+#define BOOTLOADER__SERVICES_MAGIC	0x5342
+#define BOOTLOADER__SERVICES_VERSION	1
+#define BOOTLOADER__SERVICES_WORDS	52
+#define BOOTLOADER__SERVICES_CODE	,									\
+  BOOTLOADER__SERVICES_MAGIC, (BOOTLOADER__SERVICES_VERSION | (2<<8)), 0xc001, 0xc023,		\
+  0xbf8b, 0x01fb, 0x01c9, 0x1541, 0x0551, 0xf0d9, 0x9127, 0x2782,					\
+  0x2f28, 0x9522, 0x2728, 0x2e02, 0x9526, 0x9526, 0x2520, 0x2e02,					\
+  0x9526, 0x2520, 0x7027, 0x2e08, 0x2f89, 0x9526, 0x9407, 0x9527,					\
+  0x2d90, 0x2782, 0x9406, 0x9527, 0x2590, 0x2782, 0x5041, 0x4050,					\
+  0xf729, 0xbe1b, 0x9508,										\
+  0xbf6b, 0x01fa, 0x01dc, 0x1521, 0x0531, 0xf029, 0x9007, 0x920d,					\
+  0x5021, 0x4030, 0xf7d9, 0xbe1b, 0x9508
+/*
+00000000 <bootloader__services>:
+       0:	42 53       	.word	0x5342		; magic
+       2:	01 02       	.word	0x0201		; version 1, 2 services
+       4:	01 c0       	rjmp	.+2      	; 0x8 <crc16>
+       6:	23 c0       	rjmp	.+70     	; 0x4e <memcpy>
+
+00000008 <crc16>:
+       8:	8b bf       	out	0x3b, r24	; rampZ=hh8(address)
+       a:	fb 01       	movw	r30, r22
+       c:	c9 01       	movw	r24, r18
+       e:	41 15       	cp	r20, r1
+      10:	51 05       	cpc	r21, r1
+      12:	d9 f0       	breq	.+54     	; 0x4a <crcdone>
+
+00000014 <crcloop>:
+      14:	27 91       	elpm	r18, Z+
+      16:	82 27       	eor	r24, r18	; same sequence as "_crc16_update()"
+      18:	28 2f       	mov	r18, r24
+      1a:	22 95       	swap	r18
+      1c:	28 27       	eor	r18, r24
+      1e:	02 2e       	mov	r0, r18
+      20:	26 95       	lsr	r18
+      22:	26 95       	lsr	r18
+      24:	20 25       	eor	r18, r0
+      26:	02 2e       	mov	r0, r18
+      28:	26 95       	lsr	r18
+      2a:	20 25       	eor	r18, r0
+      2c:	27 70       	andi	r18, 0x07	; 7
+      2e:	08 2e       	mov	r0, r24
+      30:	89 2f       	mov	r24, r25
+      32:	26 95       	lsr	r18
+      34:	07 94       	ror	r0
+      36:	27 95       	ror	r18
+      38:	90 2d       	mov	r25, r0
+      3a:	82 27       	eor	r24, r18
+      3c:	06 94       	lsr	r0
+      3e:	27 95       	ror	r18
+      40:	90 25       	eor	r25, r0
+      42:	82 27       	eor	r24, r18
+      44:	41 50       	subi	r20, 0x01	; 1
+      46:	50 40       	sbci	r21, 0x00	; 0
+      48:	29 f7       	brne	.-54     	; 0x14 <crcloop>
+
+0000004a <crcdone>:
+      4a:	1b be       	out	0x3b, r1
+      4c:	08 95       	ret
+
+0000004e <memcpy>:
+      4e:	6b bf       	out	0x3b, r22	; rampZ=hh8(address)
+      50:	fa 01       	movw	r30, r20
+      52:	dc 01       	movw	r26, r24
+      54:	21 15       	cp	r18, r1
+      56:	31 05       	cpc	r19, r1
+      58:	29 f0       	breq	.+10     	; 0x64 <cpydone>
+
+0000005a <cpyloop>:
+      5a:	07 90       	elpm	r0, Z+
+      5c:	0d 92       	st	X+, r0
+      5e:	21 50       	subi	r18, 0x01	; 1
+      60:	30 40       	sbci	r19, 0x00	; 0
+      62:	d9 f7       	brne	.-10     	; 0x5a <cpyloop>
+
+00000064 <cpydone>:
+      64:	1b be       	out	0x3b, r1
+      66:	08 95       	ret
+*/
+#else
+#define BOOTLOADER__SERVICES_WORDS	0
+#define BOOTLOADER__SERVICES_CODE
+#endif
+
 #if (HAVE_SPMINTEREFACE) && (defined(BOOTLOADER_ADDRESS)) && (!(defined(NEW_BOOTLOADER_ADDRESS)))
 
 /*
@@ -633,7 +767,7 @@ const uint16_t bootloader__do_spm[15] BOOTLIBLINK = {
 
 //assume  SPMCR:=SPMCSR==0x68, SPMEN==0x0, RWWSRE=0x4, RWWSB=0x6 and rampZ=0x3b
 #if HAVE_SPMINTEREFACE_MAGICVALUE
-const uint16_t bootloader__do_spm[28] BOOTLIBLINK = {
+const uint16_t bootloader__do_spm[28+BOOTLOADER__SERVICES_WORDS] BOOTLIBLINK = {
   (((0x30 | ((HAVE_SPMINTEREFACE_MAGICVALUE >> 28) & 0xf))<<8) | (0x70 | ((HAVE_SPMINTEREFACE_MAGICVALUE >> 24) & 0xf))), // r23
   bootloader__do_spm_magic_exitstrategy(0xf4c9), // brne +21+4
   (((0x30 | ((HAVE_SPMINTEREFACE_MAGICVALUE >> 20) & 0xf))<<8) | (0x60 | ((HAVE_SPMINTEREFACE_MAGICVALUE >> 16) & 0xf))), // r22
@@ -643,11 +777,11 @@ const uint16_t bootloader__do_spm[28] BOOTLIBLINK = {
   (((0x30 | ((HAVE_SPMINTEREFACE_MAGICVALUE >>  4) & 0xf))<<8) | (0x40 | ((HAVE_SPMINTEREFACE_MAGICVALUE >>  0) & 0xf))), // r20
   bootloader__do_spm_magic_exitstrategy(0xf499), // brne +15+4
 #else
-const uint16_t bootloader__do_spm[20] BOOTLIBLINK = {
+const uint16_t bootloader__do_spm[20+BOOTLOADER__SERVICES_WORDS] BOOTLIBLINK = {
 #endif
   0xbebb, 0x2dec, 0x2dfd, 0x90b0, 0x0068, 0xfcb0, 0xcffc, 0x9320, 0x0068,
   0x95e8, 0x90b0, 0x0068, 0xfcb0, 0xcffc, 0xe121, 0x90b0, 0x0068, 0xfcb6,
-  0xcff0, 0x9508
+  0xcff0, 0x9508 BOOTLOADER__SERVICES_CODE
 };
 /*
 0001e08c <bootloader__do_spm>:
@@ -721,7 +855,7 @@ const uint16_t bootloader__do_spm[20] BOOTLIBLINK = {
 
 //assume  SPMCR:=SPCSR==0x37, SPMEN==0x0, RWWSRE=0x4, RWWSB=0x6 and rampZ=0x3b
 #if HAVE_SPMINTEREFACE_MAGICVALUE
-const uint16_t bootloader__do_spm[24] BOOTLIBLINK = {
+const uint16_t bootloader__do_spm[24+BOOTLOADER__SERVICES_WORDS] BOOTLIBLINK = {
   (((0x30 | ((HAVE_SPMINTEREFACE_MAGICVALUE >> 28) & 0xf))<<8) | (0x70 | ((HAVE_SPMINTEREFACE_MAGICVALUE >> 24) & 0xf))), // r23
   bootloader__do_spm_magic_exitstrategy(0xf4a9), // brne +21
   (((0x30 | ((HAVE_SPMINTEREFACE_MAGICVALUE >> 20) & 0xf))<<8) | (0x60 | ((HAVE_SPMINTEREFACE_MAGICVALUE >> 16) & 0xf))), // r22
@@ -731,11 +865,11 @@ const uint16_t bootloader__do_spm[24] BOOTLIBLINK = {
   (((0x30 | ((HAVE_SPMINTEREFACE_MAGICVALUE >>  4) & 0xf))<<8) | (0x40 | ((HAVE_SPMINTEREFACE_MAGICVALUE >>  0) & 0xf))), // r20
   bootloader__do_spm_magic_exitstrategy(0xf479), // brne +15
 #else
-const uint16_t bootloader__do_spm[16] BOOTLIBLINK = {
+const uint16_t bootloader__do_spm[16+BOOTLOADER__SERVICES_WORDS] BOOTLIBLINK = {
 #endif
   0xbebb,
   0x2dec, 0x2dfd, 0xb6b7, 0xfcb0, 0xcffd, 0xbf27, 0x95e8, 0xb6b7,
-  0xfcb0, 0xcffd, 0xe121, 0xb6b7, 0xfcb6, 0xcff4, 0x9508
+  0xfcb0, 0xcffd, 0xe121, 0xb6b7, 0xfcb6, 0xcff4, 0x9508 BOOTLOADER__SERVICES_CODE
 };
 /*
 00001826 <bootloader__do_spm>:
@@ -98,6 +98,25 @@
  * of the macros usbDisableAllRequests() and usbEnableAllRequests() in
  * usbdrv.h.
  */
+#define USB_CFG_RX_CRC_STATUS           HAVE_RXCRCCHECK
+/* Define this to 1 to have usbPoll() check the CRC16 of each received data
+ * packet before it is processed: usbRxCrcError is nonzero while
+ * usbFunctionSetup() or usbFunctionWrite() handle a damaged packet. The
+ * packet has been acknowledged already, so the application must arrange
+ * for a retry.
+ */
+#define USB_CFG_RX_QUEUE                ((HAVE_RXQUEUE) ? (RXQUEUE_SLOTS) : 0)
+/* Define this to the number of packets usbPoll() may queue while the
+ * application function usbRxQueueHold() returns nonzero (0 disables the
+ * queue). Queued packets are already acknowledged, the interrupt routine
+ * NAKs only when the queue is full.
+ */
+#define USB_CFG_TX_DOUBLEBUFFER         HAVE_USBTXDOUBLEBUFFER
+/* Define this to 1 to prepare the next control-in data packet (including
+ * CRC) in a second transmit buffer while the current one is sent. The
+ * interrupt routine swaps the buffers, which adds 11 cycles to the IN
+ * response time -- therefore only allowed with 16 MHz or more.
+ */
 #if defined(BOOTLOADER_ADDRESS)
 #	define USB_CFG_DRIVER_FLASH_PAGE       (BOOTLOADER_ADDRESS >> 16)
 #else
@@ -164,10 +183,11 @@
 /* define this macro to 1 if you want the function usbMeasureFrameLength()
  * compiled in. This function can be used to calibrate the AVR's RC oscillator.
  */
-#define USB_USE_FAST_CRC                0
+#define USB_USE_FAST_CRC                HAVE_RXCRCCHECK
 /* The assembler module has two implementations for the CRC algorithm. One is
  * faster, the other is smaller. This CRC routine is only used for transmitted
- * messages where timing is not critical. The faster routine needs 31 cycles
+ * messages (and received ones with USB_CFG_RX_CRC_STATUS) where timing is not
+ * critical. The faster routine needs 31 cycles
  * per byte while the smaller one needs 61 to 69 cycles. The faster routine
  * may be worth the 32 bytes bigger code size if you transmit lots of data and
  * run the AVR close to its limit.
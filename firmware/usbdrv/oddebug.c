@@ -13,6 +13,142 @@
 
 #warning "Never compile production devices with debugging enabled"
 
+#if DEBUG_TRACE
+
+#if (ODDBG_TRACE_BUFSIZE & (ODDBG_TRACE_BUFSIZE - 1)) || ODDBG_TRACE_BUFSIZE > 256
+#   error "ODDBG_TRACE_BUFSIZE must be a power of 2 and not more than 256"
+#endif
+
+#define TRACE_MASK  (ODDBG_TRACE_BUFSIZE - 1)
+
+static uchar            traceBuf[ODDBG_TRACE_BUFSIZE];
+static volatile uchar   traceHead;      /* only written by odDebug() */
+static volatile uchar   traceTail;      /* only written by the drain */
+static uchar            traceDropped;   /* records lost since last report */
+
+static uchar    traceFree(void)
+{
+    return (uchar)(traceTail - traceHead - 1) & TRACE_MASK;
+}
+
+/* Caller must have checked that 5 + len bytes are free. The new record is
+ * published with a single store to traceHead, so the drain never sees a
+ * partial record.
+ */
+static void tracePut(uchar prefix, uchar *data, uchar len)
+{
+uchar   head = traceHead;
+unsigned timestamp = TCNT1;
+
+    traceBuf[head] = ODDBG_TRACE_SYNC;
+    head = (head + 1) & TRACE_MASK;
+    traceBuf[head] = prefix;
+    head = (head + 1) & TRACE_MASK;
+    traceBuf[head] = timestamp;
+    head = (head + 1) & TRACE_MASK;
+    traceBuf[head] = timestamp >> 8;
+    head = (head + 1) & TRACE_MASK;
+    traceBuf[head] = len;
+    head = (head + 1) & TRACE_MASK;
+    while(len--){
+        traceBuf[head] = *data++;
+        head = (head + 1) & TRACE_MASK;
+    }
+    traceHead = head;
+}
+
+void    odDebug(uchar prefix, uchar *data, uchar len)
+{
+    if(len > ODDBG_TRACE_MAXDATA)
+        len = ODDBG_TRACE_MAXDATA;
+    if(traceDropped){
+        uchar   dropped = traceDropped;
+        if(traceFree() < 5 + 1 + 5 + len){
+            if(dropped != 0xff)
+                traceDropped = dropped + 1;
+            return;
+        }
+        traceDropped = 0;
+        tracePut(ODDBG_TRACE_DROPPED, &dropped, 1);
+    }else if(traceFree() < 5 + len){
+        traceDropped = 1;
+        return;
+    }
+    tracePut(prefix, data, len);
+#if DEBUG_TRACE_UDRE_ISR
+    ODDBG_UCR |= (1 << ODDBG_UDRIE);
+#endif
+}
+
+#if DEBUG_TRACE_UDRE_ISR
+
+#include <avr/interrupt.h>
+
+/* V-USB does not tolerate more than a few cycles of interrupt latency. The
+ * entry stub therefore only masks the (level triggered) UDRE interrupt and
+ * re-enables interrupts before the compiler generated handler does any work.
+ */
+void __vector_odDebugUdre(void) __attribute__((signal, used));
+
+ISR(ODDBG_UDRE_vect, ISR_NAKED)
+{
+    asm volatile(
+        "push   r24\n\t"
+        "in     r24, __SREG__\n\t"
+        "push   r24\n\t"
+        "lds    r24, %[ucr]\n\t"
+        "andi   r24, %[mask]\n\t"
+        "sts    %[ucr], r24\n\t"
+        "pop    r24\n\t"
+        "out    __SREG__, r24\n\t"
+        "pop    r24\n\t"
+        "sei\n\t"
+        "%~jmp  __vector_odDebugUdre\n\t"
+        :
+        : [ucr]  "n" (_SFR_MEM_ADDR(ODDBG_UCR)),
+          [mask] "M" ((uchar)~(1 << ODDBG_UDRIE))
+    );
+}
+
+void __vector_odDebugUdre(void)
+{
+uchar   tail = traceTail;
+
+    if(tail != traceHead){
+        ODDBG_UDR = traceBuf[tail];
+        traceTail = (tail + 1) & TRACE_MASK;
+        ODDBG_UCR |= (1 << ODDBG_UDRIE);
+    }
+}
+
+void    odDebugFlush(void)
+{
+    while(traceTail != traceHead);  /* interrupts must be enabled */
+}
+
+#else
+
+void    odDebugPoll(void)
+{
+uchar   tail = traceTail;
+
+    while(tail != traceHead && (ODDBG_USR & (1 << ODDBG_UDRE))){
+        ODDBG_UDR = traceBuf[tail];
+        tail = (tail + 1) & TRACE_MASK;
+    }
+    traceTail = tail;
+}
+
+void    odDebugFlush(void)
+{
+    while(traceTail != traceHead)
+        odDebugPoll();
+}
+
+#endif
+
+#else /* DEBUG_TRACE */
+
 static void uartPutc(char c)
 {
     while(!(ODDBG_USR & (1 << ODDBG_UDRE)));    /* wait for data register empty */
@@ -46,4 +182,6 @@ void    odDebug(uchar prefix, uchar *data, uchar len)
     uartPutc('\n');
 }
 
+#endif /* DEBUG_TRACE */
+
 #endif
@@ -20,6 +20,20 @@ calls are no-ops. If it is 1, DBG1 logs will appear, but not DBG2. If it is
 
 A debug log consists of a label ('prefix') to indicate which debug log created
 the output and a memory block to dump in hex ('data' and 'len').
+
+Printing hex synchronously stalls the caller for several milliseconds per log,
+which changes the timing of the code under test. If 'DEBUG_TRACE' is defined
+to a non-zero value, DBG1 and DBG2 instead append a compact binary record to a
+RAM ring buffer and return immediately. The buffer is drained by calling
+odDebugPoll() from the main loop (or, if 'DEBUG_TRACE_UDRE_ISR' is non-zero,
+by the UART data register empty interrupt). Each record is:
+
+    0xa5, prefix, timestamp-low, timestamp-high, len, data[len]
+
+The timestamp is TCNT1 running at F_CPU/64. If the buffer overflows, the
+dropped records are counted and reported with a record of prefix 0xfe and one
+data byte holding the number of lost records. "tools/tracedecode" renders the
+record stream as a timeline on the host.
 */
 
 
@@ -43,6 +57,33 @@ the output and a memory block to dump in hex ('data' and 'len').
 #   define  DEBUG_LEVEL 0
 #endif
 
+#if DEBUG_LEVEL < 1
+#   undef   DEBUG_TRACE
+#endif
+
+#ifndef DEBUG_TRACE
+#   define  DEBUG_TRACE 0
+#endif
+
+#ifndef DEBUG_TRACE_UDRE_ISR
+#   define  DEBUG_TRACE_UDRE_ISR    0
+#endif
+
+#ifndef ODDBG_BAUDRATE
+#   define  ODDBG_BAUDRATE  19200
+#endif
+
+#ifndef ODDBG_TRACE_BUFSIZE
+#   define  ODDBG_TRACE_BUFSIZE     64  /* must be a power of 2 and <= 256 */
+#endif
+
+#ifndef ODDBG_TRACE_MAXDATA
+#   define  ODDBG_TRACE_MAXDATA     8   /* longer data blocks are truncated */
+#endif
+
+#define ODDBG_TRACE_SYNC        0xa5
+#define ODDBG_TRACE_DROPPED     0xfe
+
 /* ------------------------------------------------------------------------- */
 
 #if DEBUG_LEVEL > 0
@@ -61,6 +102,12 @@ the output and a memory block to dump in hex ('data' and 'len').
 
 #if DEBUG_LEVEL > 0
 extern void odDebug(uchar prefix, uchar *data, uchar len);
+#if DEBUG_TRACE
+#if !DEBUG_TRACE_UDRE_ISR
+extern void odDebugPoll(void);  /* send pending trace bytes without blocking */
+#endif
+extern void odDebugFlush(void); /* block until the trace buffer is empty */
+#endif
 
 /* Try to find our control registers; ATMEL likes to rename these */
 
@@ -108,15 +155,39 @@ extern void odDebug(uchar prefix, uchar *data, uchar len);
 #   define  ODDBG_UDR   UDR0
 #endif
 
+#if defined UDRIE
+#   define  ODDBG_UDRIE UDRIE
+#else
+#   define  ODDBG_UDRIE UDRIE0
+#endif
+
+#if defined USART_UDRE_vect
+#   define  ODDBG_UDRE_vect USART_UDRE_vect
+#elif defined USART0_UDRE_vect
+#   define  ODDBG_UDRE_vect USART0_UDRE_vect
+#elif defined UART_UDRE_vect
+#   define  ODDBG_UDRE_vect UART_UDRE_vect
+#endif
+
 static inline void  odDebugInit(void)
 {
     ODDBG_UCR |= (1<<ODDBG_TXEN);
-    ODDBG_UBRR = F_CPU / (19200 * 16L) - 1;
+    ODDBG_UBRR = F_CPU / (ODDBG_BAUDRATE * 16L) - 1;
+#if DEBUG_TRACE
+    TCCR1B = (1<<CS11) | (1<<CS10); /* free running timestamp at F_CPU/64 */
+#endif
 }
 #else
 #   define odDebugInit()
 #endif
 
+#if !DEBUG_TRACE || DEBUG_TRACE_UDRE_ISR
+#   define odDebugPoll()
+#endif
+#if !DEBUG_TRACE
+#   define odDebugFlush()
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 #endif /* __oddebug_h_included__ */
@@ -28,7 +28,17 @@ volatile schar usbRxLen;        /* = 0; number of bytes in usbRxBuf; 0 means fre
 uchar       usbCurrentTok;      /* last token received or endpoint number for last OUT token if != 0 */
 uchar       usbRxToken;         /* token for data we received; or endpont number for last OUT */
 volatile uchar usbTxLen = USBPID_NAK;   /* number of bytes to transmit with next IN token or handshake token */
+#if USB_CFG_TX_DOUBLEBUFFER
+/* The buffer pair must not cross a 256 byte boundary (assembler code only
+ * adds the offset to the low byte of the address).
+ */
+uchar       usbTxBuf[2*USB_BUFSIZE] __attribute__((aligned(32)));/* two tx buffers, see usbTxBufOffset */
+uchar       usbTxBufOffset;     /* offset in usbTxBuf of the buffer sent with next IN, the other one is prepared */
+volatile uchar usbTxLenNext = USBPID_NAK;   /* length of the prepared packet, moved to usbTxLen by the ISR */
+static uchar   usbTxDataToken;  /* DATA0/DATA1 of the last packet built */
+#else
 uchar       usbTxBuf[USB_BUFSIZE];/* data to transmit with next IN, free if usbTxLen contains handshake token */
+#endif
 #if USB_COUNT_SOF
 volatile uchar  usbSofCount;    /* incremented by assembler module every SOF */
 #endif
@@ -41,6 +51,19 @@ usbTxStatus_t  usbTxStatus3;
 #if USB_CFG_CHECK_DATA_TOGGLING
 uchar       usbCurrentDataToken;/* when we check data toggling to ignore duplicate packets */
 #endif
+#if USB_CFG_RX_CRC_STATUS
+uchar       usbRxCrcError;      /* CRC16 of the packet being processed did not match */
+#endif
+#if USB_CFG_RX_QUEUE
+typedef struct usbRxSlot{
+    uchar   token;              /* usbRxToken of the packet */
+    uchar   len;                /* number of data bytes */
+    uchar   data[USB_BUFSIZE - 1];  /* data and CRC, without PID */
+}usbRxSlot_t;
+static usbRxSlot_t  usbRxQueue[USB_CFG_RX_QUEUE];   /* packets received while usbRxQueueHold() */
+static uchar        usbRxQueueHead; /* index of the oldest packet */
+static uchar        usbRxQueueCount;/* number of packets in usbRxQueue */
+#endif
 
 /* USB status registers / not shared with asm code */
 usbMsgPtr_t         usbMsgPtr;      /* data to transmit next -- ROM or RAM address */
@@ -418,28 +441,33 @@ skipMsgPtrAssignment:
  * routine. It distinguishes between SETUP and DATA packets and processes
  * them accordingly.
  */
-static inline void usbProcessRx(uchar *data, uchar len)
+static inline void usbProcessRx(uchar *data, uchar len, uchar token)
 {
 usbRequest_t    *rq = (void *)data;
 
-/* usbRxToken can be:
+/* token (usbRxToken of the packet) can be:
  * 0x2d 00101101 (USBPID_SETUP for setup data)
  * 0xe1 11100001 (USBPID_OUT: data phase of setup transfer)
  * 0...0x0f for OUT on endpoint X
  */
-    DBG2(0x10 + (usbRxToken & 0xf), data, len + 2); /* SETUP=1d, SETUP-DATA=11, OUTx=1x */
+    DBG2(0x10 + (token & 0xf), data, len + 2); /* SETUP=1d, SETUP-DATA=11, OUTx=1x */
     USB_RX_USER_HOOK(data, len)
 #if USB_CFG_IMPLEMENT_FN_WRITEOUT
-    if(usbRxToken < 0x10){  /* OUT to endpoint != 0: endpoint number in usbRxToken */
+    if(token < 0x10){  /* OUT to endpoint != 0: endpoint number in usbRxToken */
         usbFunctionWriteOut(data, len);
         return;
     }
 #endif
-    if(usbRxToken == (uchar)USBPID_SETUP){
+    if(token == (uchar)USBPID_SETUP){
         if(len != 8)    /* Setup size must be always 8 bytes. Ignore otherwise. */
             return;
         usbMsgLen_t replyLen;
+#if USB_CFG_TX_DOUBLEBUFFER
+        usbTxDataToken = USBPID_DATA0;      /* initialize data toggling */
+        usbTxLenNext = USBPID_NAK;          /* abort prepared transmit */
+#else
         usbTxBuf[0] = USBPID_DATA0;         /* initialize data toggling */
+#endif
         usbTxLen = USBPID_NAK;              /* abort pending transmit */
         usbMsgFlags = 0;
         uchar type = rq->bmRequestType & USBRQ_TYPE_MASK;
@@ -469,7 +497,7 @@ usbRequest_t    *rq = (void *)data;
                 replyLen = rq->wLength.word;
         }
         usbMsgLen = replyLen;
-    }else{  /* usbRxToken must be USBPID_OUT, which means data phase of setup (control-out) */
+    }else{  /* token must be USBPID_OUT, which means data phase of setup (control-out) */
 #if USB_CFG_IMPLEMENT_FN_WRITE
         if(usbMsgFlags & USB_FLG_USE_USER_RW){
             uchar rval = usbFunctionWrite(data, len);
@@ -519,6 +547,55 @@ static uchar usbDeviceRead(uchar *data, uchar len)
 
 /* ------------------------------------------------------------------------- */
 
+#if USB_CFG_TX_DOUBLEBUFFER
+/* usbBuildTxBlock() is called when we have data to transmit and one of the
+ * two transmit buffers is free: If the interrupt routine has nothing to send,
+ * the current buffer is filled. Otherwise the next packet is prepared in the
+ * other buffer while the current one is on the wire -- the interrupt routine
+ * swaps the buffers when sending and moves usbTxLenNext to usbTxLen.
+ */
+static inline void usbBuildTxBlock(void)
+{
+usbMsgLen_t wantLen;
+uchar       len, offset, sreg;
+uchar       *txBuf;
+
+    sreg = SREG;
+    cli();
+    offset = usbTxBufOffset;
+    if(!(usbTxLen & 0x10))  /* current buffer busy: prepare the other one */
+        offset = USB_BUFSIZE - offset;
+    SREG = sreg;
+    txBuf = usbTxBuf + offset;
+    wantLen = usbMsgLen;
+    if(wantLen > 8)
+        wantLen = 8;
+    usbMsgLen -= wantLen;
+    usbTxDataToken ^= USBPID_DATA0 ^ USBPID_DATA1; /* DATA toggling */
+    txBuf[0] = usbTxDataToken;
+    len = usbDeviceRead(txBuf + 1, wantLen);
+    if(len <= 8){           /* valid data packet */
+        usbCrc16Append(&txBuf[1], len);
+        len += 4;           /* length including sync byte */
+        if(len < 12)        /* a partial package identifies end of message */
+            usbMsgLen = USB_NO_MSG;
+    }else{
+        len = USBPID_STALL;   /* stall the endpoint */
+        usbMsgLen = USB_NO_MSG;
+    }
+    /* If the current packet was sent meanwhile, the buffers have been swapped
+     * and usbTxLen is free: our buffer is the current one now.
+     */
+    cli();
+    if(offset == usbTxBufOffset){
+        usbTxLen = len;
+    }else{
+        usbTxLenNext = len;
+    }
+    SREG = sreg;
+    DBG2(0x20, txBuf, len-1);
+}
+#else
 /* usbBuildTxBlock() is called when we have data to transmit and the
  * interrupt routine's transmit buffer is empty.
  */
@@ -545,6 +622,7 @@ uchar       len;
     usbTxLen = len;
     DBG2(0x20, usbTxBuf, len-1);
 }
+#endif
 
 /* ------------------------------------------------------------------------- */
 
@@ -565,28 +643,110 @@ uchar           isReset = !notResetState;
 
 /* ------------------------------------------------------------------------- */
 
-USB_PUBLIC void usbPoll(void)
+/* usbRxPacket() checks the CRC (if configured) and processes a received
+ * packet, "data" points behind the PID.
+ */
+static void usbRxPacket(uchar *data, uchar len, uchar token)
 {
-schar   len;
-uchar   i;
-
-    len = usbRxLen - 3;
-    if(len >= 0){
 /* We could check CRC16 here -- but ACK has already been sent anyway. If you
  * need data integrity checks with this driver, check the CRC in your app
  * code and report errors back to the host. Since the ACK was already sent,
  * retries must be handled on application level.
  * unsigned crc = usbCrc16(buffer + 1, usbRxLen - 3);
  */
-        usbProcessRx(usbRxBuf + USB_BUFSIZE + 1 - usbInputBufOffset, len);
+#if USB_CFG_RX_CRC_STATUS
+    {
+        usbWord_t crc;
+        crc.word = usbCrc16(data, len);
+        usbRxCrcError = (crc.bytes[0] != data[len]) || (crc.bytes[1] != data[len + 1]);
+    }
+#endif
+    usbProcessRx(data, len, token);
+}
+
+#if USB_CFG_RX_QUEUE
+/* Moves the packet in usbRxBuf to the end of the queue. A SETUP aborts the
+ * previous control transfer, so its unprocessed packets are dropped.
+ */
+static void usbRxQueuePut(uchar *data, uchar len)
+{
+usbRxSlot_t *slot;
+uchar       i;
+
+    if(usbRxToken == (uchar)USBPID_SETUP){
+        usbRxQueueCount = 0;
+#if USB_CFG_TX_DOUBLEBUFFER
+        usbTxLenNext = USBPID_NAK;
+#endif
+        usbTxLen = USBPID_NAK;  /* abort pending transmit now, the SETUP is processed later */
+        usbMsgLen = USB_NO_MSG;
+    }
+    i = usbRxQueueHead + usbRxQueueCount;
+    if(i >= USB_CFG_RX_QUEUE)
+        i -= USB_CFG_RX_QUEUE;
+    slot = &usbRxQueue[i];
+    slot->token = usbRxToken;
+    slot->len = len;
+    for(i = 0; i < sizeof(slot->data); i++)
+        slot->data[i] = data[i];
+    usbRxQueueCount++;
+}
+
+/* Processes queued packets in order as long as usbRxQueueHold() allows. */
+static void usbRxQueueDrain(void)
+{
+usbRxSlot_t *slot;
+
+    while(usbRxQueueCount && !usbRxQueueHold()){
+        slot = &usbRxQueue[usbRxQueueHead];
+        if(++usbRxQueueHead >= USB_CFG_RX_QUEUE)
+            usbRxQueueHead = 0;
+        usbRxQueueCount--;
+        usbRxPacket(slot->data, slot->len, slot->token);
+    }
+}
+#endif
+
+USB_PUBLIC void usbPoll(void)
+{
+schar   len;
+uchar   i;
+
+    len = usbRxLen - 3;
+    if(len >= 0){
+        uchar *data = usbRxBuf + USB_BUFSIZE + 1 - usbInputBufOffset;
+#if USB_CFG_RX_QUEUE
+        /* Keep the order: once a packet is queued, all following ones are.
+         * If the queue is full, the packet stays in usbRxBuf and the
+         * interrupt routine NAKs until a slot is free.
+         */
+        if(usbRxQueueCount || usbRxQueueHold()){
+            if(usbRxQueueCount < USB_CFG_RX_QUEUE){
+                usbRxQueuePut(data, len);
+                usbRxLen = 0;   /* mark rx buffer as available */
+            }
+        }else
+#endif
+        {
+            usbRxPacket(data, len, usbRxToken);
 #if USB_CFG_HAVE_FLOWCONTROL
-        if(usbRxLen > 0)    /* only mark as available if not inactivated */
-            usbRxLen = 0;
+            if(usbRxLen > 0)    /* only mark as available if not inactivated */
+                usbRxLen = 0;
 #else
-        usbRxLen = 0;       /* mark rx buffer as available */
+            usbRxLen = 0;       /* mark rx buffer as available */
 #endif
+        }
     }
+#if USB_CFG_RX_QUEUE
+    usbRxQueueDrain();
+    /* as the interrupt routine does for usbRxBuf: no transmit before all input is processed */
+    if(!usbRxQueueCount)
+#endif
+#if USB_CFG_TX_DOUBLEBUFFER
+    if(usbTxLenNext & 0x10){    /* a transmit buffer is free (always if usbTxLen is idle) */
+#else
     if(usbTxLen & 0x10){    /* transmit system idle */
+#endif
         if(usbMsgLen != USB_NO_MSG){    /* transmit data pending? */
             usbBuildTxBlock();
         }
@@ -599,6 +759,9 @@ uchar   i;
     /* RESET condition, called multiple times during reset */
     usbNewDeviceAddr = 0;
     usbDeviceAddr = 0;
+#if USB_CFG_RX_QUEUE
+    usbRxQueueCount = 0;
+#endif
     usbResetStall();
     DBG1(0xff, 0, 0);
 isNotReset:
@@ -312,6 +312,15 @@ USB_PUBLIC void usbFunctionWriteOut(uchar *data, uchar len);
  * usbconfig.h to get this function called.
  */
 #endif /* USB_CFG_IMPLEMENT_FN_WRITEOUT */
+#if USB_CFG_RX_QUEUE
+USB_PUBLIC uchar usbRxQueueHold(void);
+/* This function is called by usbPoll() with USB_CFG_RX_QUEUE. As long as it
+ * returns nonzero, received packets are not processed but moved to the
+ * receive queue, so the interrupt routine can accept (ACK) the next one.
+ * Return nonzero while usbFunctionWrite() would have to wait, e.g. for a
+ * flash page write in progress.
+ */
+#endif /* USB_CFG_RX_QUEUE */
 #ifdef USB_CFG_PULLUP_IOPORTNAME
 #define usbDeviceConnect()      ((USB_PULLUP_DDR |= (1<<USB_CFG_PULLUP_BIT)), \
                                   (USB_PULLUP_OUT |= (1<<USB_CFG_PULLUP_BIT)))
@@ -381,6 +390,12 @@ extern uchar    usbCurrentDataToken;
 /* This macro builds a descriptor header for a string descriptor given the
  * string's length. See usbdrv.c for an example how to use it.
  */
+#if USB_CFG_RX_CRC_STATUS
+extern uchar    usbRxCrcError;
+/* Nonzero while the packet currently processed by usbFunctionSetup() or
+ * usbFunctionWrite() failed its CRC16 check (see USB_CFG_RX_CRC_STATUS).
+ */
+#endif
 #if USB_CFG_HAVE_FLOWCONTROL
 extern volatile schar   usbRxLen;
 #define usbDisableAllRequests()     usbRxLen = -1
@@ -591,6 +606,21 @@ int usbDescriptorStringSerialNumber[];
 
 #define USB_BUFSIZE     11  /* PID, 8 bytes data, 2 bytes CRC */
 
+#ifndef USB_CFG_TX_DOUBLEBUFFER
+#define USB_CFG_TX_DOUBLEBUFFER 0
+#endif
+
+#ifndef USB_CFG_RX_CRC_STATUS
+#define USB_CFG_RX_CRC_STATUS   0
+#endif
+
+#ifndef USB_CFG_RX_QUEUE
+#define USB_CFG_RX_QUEUE        0
+#endif
+#if USB_CFG_RX_QUEUE && (USB_CFG_IMPLEMENT_FN_WRITEOUT || USB_CFG_HAVE_FLOWCONTROL || USB_CFG_CHECK_DATA_TOGGLING)
+#error "USB_CFG_RX_QUEUE is only implemented for control transfers without flow control and data toggle checks"
+#endif
+
 /* ----- Try to find registers and bits responsible for ext interrupt 0 ----- */
 
 #ifndef USB_INTR_CFG    /* allow user to override our default */
@@ -123,6 +123,7 @@ static inline void  sei(void)
 #   define _VECTOR(N)   __vector_ ## N   /* io.h does not define this for asm */
 #else
 #   include <avr/pgmspace.h>
+#   include <avr/interrupt.h>
 #endif
 
 #if USB_CFG_DRIVER_FLASH_PAGE
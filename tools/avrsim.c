@@ -0,0 +1,1201 @@
+/* Name: avrsim.c
+ * Project: USBaspLoader
+ * Creation Date: 2026-10-18
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ */
+
+/*
+ * Minimal AVR instruction set simulator for cycle profiling of "main.elf"
+ * (bootloader) and "updater.elf" without depending on external simulators.
+ *
+ * It implements the classic megaAVR instruction set as emitted by avr-gcc
+ * (including lpm/elpm and spm) with datasheet cycle counts. Modelled
+ * peripherals are SPMCR (page buffer, erase, write, RWW section), the
+ * EEPROM registers and the watchdog reset instruction - everything else
+ * in IO space is plain memory. Interrupts and USB are not simulated:
+ * the USB callbacks are invoked directly by a script.
+ *
+ * Usage: avrsim -m mcu [-f F_CPU] [-t flash-ms] [-w cycles] [-l] file.elf [script]
+ *   -m  atmega8, atmega328p, atmega1284p or atmega2560
+ *   -f  CPU clock, used to convert times into cycles (default 16000000)
+ *   -t  duration of a flash page erase/write in ms (default 4.0)
+ *   -w  interrupt latency budget in cycles (default: V-USB's 25 cycles at
+ *       12 MHz, scaled to F_CPU)
+ *   -l  also attribute cycles to local assembler labels, not only functions
+ * Without a script the commands are read from stdin.
+ *
+ * Script commands (one per line, '#' starts a comment):
+ *   init [symbol]            run from the ELF entry until "symbol" (default
+ *                            "main") is reached: C runtime and .initN code
+ *   call func [arg...]       call "func" with avr-gcc calling convention
+ *                            and print cycles and return value. Arguments:
+ *                              123, 0x7b   16 bit value
+ *                              @0102ff     pointer to these bytes (copied
+ *                                          into a scratch buffer)
+ *                              &symbol     address of a RAM symbol
+ *   set symbol|addr hex...   write bytes into data memory
+ *   print symbol|addr [n]    dump n (default: symbol size) data bytes
+ *   flash addr [n]           dump n (default 16) flash bytes
+ *   profile                  print and clear the per function cycle table
+ *   load file.elf            load another ELF (flash and symbols), e.g. the
+ *                            bootloader's main.elf when profiling the updater
+ *                            calling "bootloader__do_spm"
+ *   sei, cli                 set or clear the I flag for the following calls
+ *   irq                      print and clear the interrupt blocking windows
+ * The per function table counts "exclusive" cycles: every instruction is
+ * accounted to the function (or label with -l) containing it.
+ *
+ * Interrupt blocking windows: every stretch with the I flag cleared (from
+ * the end of the clearing instruction up to the end of the instruction
+ * following the one setting it again - the earliest point an interrupt is
+ * taken) and every CPU halt with interrupts enabled (spm to the NRWW
+ * section) is recorded per start/end location. "irq" lists them by their
+ * longest occurrence and marks those exceeding the latency budget, which
+ * the V-USB interrupt needs to receive a packet.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAXCALLCYCLES   200000000ULL
+
+/* SREG bits */
+#define SREG_C  0
+#define SREG_Z  1
+#define SREG_N  2
+#define SREG_V  3
+#define SREG_S  4
+#define SREG_H  5
+#define SREG_T  6
+#define SREG_I  7
+
+/* SPMCR bits */
+#define SPM_SPMEN   0x01
+#define SPM_PGERS   0x02
+#define SPM_PGWRT   0x04
+#define SPM_BLBSET  0x08
+#define SPM_RWWSRE  0x10
+#define SPM_RWWSB   0x40
+
+/* EECR bits */
+#define EE_ERE      0x01
+#define EE_WE       0x02
+#define EE_MWE      0x04
+
+struct device {
+    const char  *name;
+    uint32_t    flashsize;
+    unsigned    pagesize;
+    unsigned    ramstart, ramend;
+    unsigned    eepromsize;
+    unsigned    nrwwstart;      /* first byte of the NRWW section */
+    int         spmcr, eecr, eedr, eearl, eearh, rampz, eind;  /* data addresses, -1: none */
+};
+
+static const struct device devices[] = {
+    { "atmega8",     8192,   64,  0x060, 0x045f,  512, 0x01800, 0x57, 0x3c, 0x3d, 0x3e, 0x3f,   -1,   -1 },
+    { "atmega328p",  32768,  128, 0x100, 0x08ff, 1024, 0x07000, 0x57, 0x3f, 0x40, 0x41, 0x42,   -1,   -1 },
+    { "atmega1284p", 131072, 256, 0x100, 0x40ff, 4096, 0x1e000, 0x57, 0x3f, 0x40, 0x41, 0x42, 0x5b,   -1 },
+    { "atmega2560",  262144, 256, 0x200, 0x21ff, 4096, 0x3e000, 0x57, 0x3f, 0x40, 0x41, 0x42, 0x5b, 0x5c },
+};
+
+#define ADDR_SPL    0x5d
+#define ADDR_SPH    0x5e
+#define ADDR_SREG   0x5f
+
+struct symbol {
+    char        *name;
+    uint32_t    addr;           /* flash: byte address, RAM: data address */
+    uint32_t    size;
+    int         isfunc;
+    uint64_t    cycles;
+};
+
+static const struct device  *dev;
+static uint8_t              flash[256 * 1024 + 4];  /* + room for prefetching a 2nd word */
+static uint8_t              data[64 * 1024];
+static uint8_t              eeprom[4096];
+static uint16_t             pagebuf[128];
+
+static uint32_t             pc;             /* word address */
+static uint64_t             cycles;
+static uint64_t             spmbusy, eebusy; /* cycles left until SPM/EEPROM operation finishes */
+static uint64_t             flashopcycles;
+static double               fcpu = 16000000.0;
+static unsigned long        wdrcount, spmcount;
+static int                  pcbytes;        /* bytes of a return address on the stack */
+static int                  stopped;
+
+static struct symbol        *textsyms, *datasyms;
+static unsigned             ntextsyms, ndatasyms;
+static int                  withlabels;
+
+#define MAXWINDOWS          256
+#define PC_RETURN           0xffffffff     /* window still open when the call returned */
+
+struct window {
+    uint32_t        startpc, endpc;         /* word addresses */
+    uint64_t        max, total;
+    unsigned long   count;
+};
+
+enum { IRQ_ON, IRQ_OFF, IRQ_CLOSING };
+
+static struct window        windows[MAXWINDOWS];
+static unsigned             nwindows;
+static unsigned long        lostwindows;
+static int                  irqstate;
+static uint64_t             irqoffsince, haltcycles;
+static uint32_t             irqoffpc;
+static double               budget;
+
+/* ------------------------------------------------------------------------ */
+/*                              ELF loader                                  */
+/* ------------------------------------------------------------------------ */
+
+static uint32_t get32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t get16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static int symcmp(const void *a, const void *b)
+{
+    const struct symbol *x = a, *y = b;
+
+    if (x->addr != y->addr)
+        return (x->addr < y->addr) ? -1 : 1;
+    return y->isfunc - x->isfunc;   /* functions before labels at the same address */
+}
+
+static uint32_t loadElf(const char *name)
+{
+    FILE        *f = fopen(name, "rb");
+    uint8_t     *elf;
+    long        size;
+    uint32_t    phoff, shoff, i;
+    unsigned    phnum, shnum, phentsize, shentsize;
+
+    if (f == NULL) {
+        perror(name);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    elf = malloc(size);
+    if ((elf == NULL) || (fread(elf, 1, size, f) != (size_t)size)) {
+        fprintf(stderr, "%s: read error\n", name);
+        exit(1);
+    }
+    fclose(f);
+    if ((size < 52) || memcmp(elf, "\x7f" "ELF\x01\x01", 6) || (get16(elf + 18) != 83)) {
+        fprintf(stderr, "%s: not a 32 bit little endian AVR ELF file\n", name);
+        exit(1);
+    }
+    phoff = get32(elf + 28);
+    shoff = get32(elf + 32);
+    phentsize = get16(elf + 42);
+    phnum = get16(elf + 44);
+    shentsize = get16(elf + 46);
+    shnum = get16(elf + 48);
+
+    /* program headers: everything loaded below 0x800000 (LMA) goes into flash */
+    for (i = 0; i < phnum; i++) {
+        const uint8_t *ph = elf + phoff + i * phentsize;
+        uint32_t offset = get32(ph + 4), paddr = get32(ph + 12), filesz = get32(ph + 16);
+
+        if ((get32(ph) != 1) || (filesz == 0) || (paddr >= 0x800000))
+            continue;
+        if (paddr + filesz > dev->flashsize) {
+            fprintf(stderr, "%s: segment at 0x%x does not fit into %s\n", name, paddr, dev->name);
+            exit(1);
+        }
+        memcpy(flash + paddr, elf + offset, filesz);
+    }
+
+    /* symbol table */
+    for (i = 0; i < shnum; i++) {
+        const uint8_t *sh = elf + shoff + i * shentsize;
+        const uint8_t *strsh;
+        uint32_t j, n;
+
+        if (get32(sh + 4) != 2)     /* SHT_SYMTAB */
+            continue;
+        strsh = elf + shoff + get32(sh + 24) * shentsize;
+        n = get32(sh + 20) / 16;
+        textsyms = realloc(textsyms, (ntextsyms + n) * sizeof(struct symbol));
+        datasyms = realloc(datasyms, (ndatasyms + n) * sizeof(struct symbol));
+        if ((textsyms == NULL) || (datasyms == NULL)) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        for (j = 1; j < n; j++) {
+            const uint8_t   *s = elf + get32(sh + 16) + j * 16;
+            const char      *sname = (const char *)elf + get32(strsh + 16) + get32(s);
+            uint32_t        value = get32(s + 4), ssize = get32(s + 8);
+            unsigned        type = s[12] & 0x0f;
+            struct symbol   *sym;
+
+            if ((sname[0] == 0) || (get16(s + 14) == 0) || (get16(s + 14) >= 0xff00))
+                continue;   /* unnamed, undefined, absolute or common */
+            if (value >= 0x800000) {
+                if ((type != 1) || (value >= 0x810000))    /* STT_OBJECT in RAM */
+                    continue;
+                sym = &datasyms[ndatasyms++];
+                value -= 0x800000;
+            } else if ((type == 2) || ((type == 0) && withlabels)) {
+                sym = &textsyms[ntextsyms++];
+            } else {
+                continue;
+            }
+            memset(sym, 0, sizeof(*sym));
+            sym->name = strdup(sname);
+            sym->addr = value;
+            sym->size = ssize;
+            sym->isfunc = (type == 2);
+        }
+        qsort(textsyms, ntextsyms, sizeof(struct symbol), symcmp);
+    }
+    i = get32(elf + 24);
+    free(elf);
+    return i;
+}
+
+static struct symbol *findSymbol(const char *name, int text)
+{
+    struct symbol   *syms = text ? textsyms : datasyms;
+    unsigned        n = text ? ntextsyms : ndatasyms, i;
+
+    for (i = 0; i < n; i++)
+        if (strcmp(syms[i].name, name) == 0)
+            return &syms[i];
+    return NULL;
+}
+
+/* symbol containing flash byte address "addr" (or the one right below it) */
+static struct symbol *symbolAt(uint32_t addr)
+{
+    int lo = 0, hi = (int)ntextsyms - 1, best = -1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (textsyms[mid].addr <= addr) {
+            best = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return (best < 0) ? NULL : &textsyms[best];
+}
+
+/* ------------------------------------------------------------------------ */
+/*                           memory and IO                                  */
+/* ------------------------------------------------------------------------ */
+
+static uint8_t readData(uint32_t addr)
+{
+    addr &= 0xffff;
+    if ((int)addr == dev->spmcr) {
+        uint8_t v = data[addr];
+        return spmbusy ? (v | SPM_SPMEN) : v;
+    }
+    if ((int)addr == dev->eecr)
+        return eebusy ? (data[addr] | EE_WE) : (data[addr] & ~EE_WE);
+    return data[addr];
+}
+
+static void writeData(uint32_t addr, uint8_t v)
+{
+    addr &= 0xffff;
+    if ((int)addr == dev->eecr) {
+        unsigned eear = (data[dev->eearl] | ((dev->eearh >= 0) ? (data[dev->eearh] << 8) : 0)) % dev->eepromsize;
+
+        if (v & EE_ERE) {
+            data[dev->eedr] = eeprom[eear];
+            cycles += 4;            /* CPU is halted during EEPROM read */
+            haltcycles += 4;
+            v &= ~EE_ERE;
+        }
+        if ((v & EE_WE) && (data[addr] & EE_MWE) && (eebusy == 0)) {
+            eeprom[eear] = data[dev->eedr];
+            eebusy = (uint64_t)(fcpu * 0.0034);     /* 3.4 ms */
+            cycles += 2;
+        }
+        data[addr] = v & ~EE_WE;
+        return;
+    }
+    data[addr] = v;
+}
+
+static uint32_t getZ(int extended)
+{
+    uint32_t z = data[30] | (data[31] << 8);
+
+    if (extended && (dev->rampz >= 0))
+        z |= (uint32_t)data[dev->rampz] << 16;
+    return z;
+}
+
+static uint8_t readFlash(uint32_t addr)
+{
+    addr %= dev->flashsize;
+    /* RWW section can not be read while busy or not yet re-enabled */
+    if ((addr < dev->nrwwstart) && (data[dev->spmcr] & SPM_RWWSB))
+        return 0xff;
+    return flash[addr];
+}
+
+static void doSpm(void)
+{
+    uint8_t     spmcr = data[dev->spmcr];
+    uint32_t    z = getZ(1), page = (z % dev->flashsize) & ~(dev->pagesize - 1);
+    unsigned    i;
+
+    spmcount++;
+    data[dev->spmcr] &= ~(SPM_SPMEN | SPM_PGERS | SPM_PGWRT | SPM_BLBSET | SPM_RWWSRE);
+    if (!(spmcr & SPM_SPMEN) || spmbusy)
+        return;
+    switch (spmcr & (SPM_PGERS | SPM_PGWRT | SPM_BLBSET | SPM_RWWSRE)) {
+    case 0:                         /* page buffer fill */
+        pagebuf[(z & (dev->pagesize - 1)) >> 1] &= data[0] | (data[1] << 8);
+        break;
+    case SPM_PGERS:
+        memset(flash + page, 0xff, dev->pagesize);
+        spmbusy = flashopcycles;
+        break;
+    case SPM_PGWRT:
+        for (i = 0; i < dev->pagesize / 2; i++) {
+            flash[page + 2 * i]     &= pagebuf[i] & 0xff;
+            flash[page + 2 * i + 1] &= pagebuf[i] >> 8;
+        }
+        memset(pagebuf, 0xff, sizeof(pagebuf));
+        spmbusy = flashopcycles;
+        break;
+    case SPM_RWWSRE:
+        data[dev->spmcr] &= ~SPM_RWWSB;
+        memset(pagebuf, 0xff, sizeof(pagebuf));
+        return;
+    default:                        /* lock bits: ignored */
+        return;
+    }
+    if (spmbusy) {
+        if (page < dev->nrwwstart)
+            data[dev->spmcr] |= SPM_RWWSB;
+        else
+            cycles += spmbusy, haltcycles += spmbusy, spmbusy = 0;  /* NRWW: CPU is halted */
+    }
+}
+
+static void push(uint8_t v)
+{
+    uint16_t sp = data[ADDR_SPL] | (data[ADDR_SPH] << 8);
+
+    data[sp] = v;
+    sp--;
+    data[ADDR_SPL] = sp & 0xff;
+    data[ADDR_SPH] = sp >> 8;
+}
+
+static uint8_t pop(void)
+{
+    uint16_t sp = data[ADDR_SPL] | (data[ADDR_SPH] << 8);
+
+    sp++;
+    data[ADDR_SPL] = sp & 0xff;
+    data[ADDR_SPH] = sp >> 8;
+    return data[sp];
+}
+
+static void pushPc(uint32_t retpc)
+{
+    push(retpc & 0xff);
+    push((retpc >> 8) & 0xff);
+    if (pcbytes > 2)
+        push((retpc >> 16) & 0xff);
+}
+
+static uint32_t popPc(void)
+{
+    uint32_t r = 0;
+
+    if (pcbytes > 2)
+        r = (uint32_t)pop() << 16;
+    r |= pop() << 8;
+    r |= pop();
+    return r;
+}
+
+/* ------------------------------------------------------------------------ */
+/*                              CPU core                                    */
+/* ------------------------------------------------------------------------ */
+
+#define SREG        data[ADDR_SREG]
+#define BIT(v, n)   (((v) >> (n)) & 1)
+#define NBIT(v, n)  (BIT(v, n) ^ 1)
+
+static void setFlag(int n, int v)
+{
+    if (v)
+        SREG |= 1 << n;
+    else
+        SREG &= ~(1 << n);
+}
+
+static void setNZS(uint8_t r)
+{
+    setFlag(SREG_N, BIT(r, 7));
+    setFlag(SREG_Z, r == 0);
+    setFlag(SREG_S, BIT(SREG, SREG_N) ^ BIT(SREG, SREG_V));
+}
+
+static uint8_t doAdd(uint8_t d, uint8_t r, int carry)
+{
+    uint8_t res = d + r + carry;
+
+    setFlag(SREG_H, (BIT(d, 3) & BIT(r, 3)) | (BIT(r, 3) & NBIT(res, 3)) | (NBIT(res, 3) & BIT(d, 3)));
+    setFlag(SREG_V, (BIT(d, 7) & BIT(r, 7) & NBIT(res, 7)) | (NBIT(d, 7) & NBIT(r, 7) & BIT(res, 7)));
+    setFlag(SREG_C, (BIT(d, 7) & BIT(r, 7)) | (BIT(r, 7) & NBIT(res, 7)) | (NBIT(res, 7) & BIT(d, 7)));
+    setNZS(res);
+    return res;
+}
+
+/* "keepz": SBC/SBCI/CPC only clear Z, never set it */
+static uint8_t doSub(uint8_t d, uint8_t r, int carry, int keepz)
+{
+    uint8_t res = d - r - carry;
+    int     z = BIT(SREG, SREG_Z);
+
+    setFlag(SREG_H, (NBIT(d, 3) & BIT(r, 3)) | (BIT(r, 3) & BIT(res, 3)) | (BIT(res, 3) & NBIT(d, 3)));
+    setFlag(SREG_V, (BIT(d, 7) & NBIT(r, 7) & NBIT(res, 7)) | (NBIT(d, 7) & BIT(r, 7) & BIT(res, 7)));
+    setFlag(SREG_C, (NBIT(d, 7) & BIT(r, 7)) | (BIT(r, 7) & BIT(res, 7)) | (BIT(res, 7) & NBIT(d, 7)));
+    setNZS(res);
+    if (keepz)
+        setFlag(SREG_Z, z && (res == 0));
+    setFlag(SREG_S, BIT(SREG, SREG_N) ^ BIT(SREG, SREG_V));
+    return res;
+}
+
+static uint8_t doLogic(uint8_t res)
+{
+    setFlag(SREG_V, 0);
+    setNZS(res);
+    return res;
+}
+
+static void doMul(int32_t res, int fractional)
+{
+    uint16_t r;
+
+    if (fractional) {
+        setFlag(SREG_C, BIT(res, 15));
+        res <<= 1;
+    } else {
+        setFlag(SREG_C, BIT(res, 15));
+    }
+    r = res & 0xffff;
+    setFlag(SREG_Z, r == 0);
+    data[0] = r & 0xff;
+    data[1] = r >> 8;
+}
+
+static int isTwoWord(uint16_t op)
+{
+    return ((op & 0xfe0f) == 0x9000) || ((op & 0xfe0f) == 0x9200) ||   /* lds, sts */
+           ((op & 0xfe0c) == 0x940c);                                   /* jmp, call */
+}
+
+/* X, Y, Z pointer access for ld/st */
+static uint16_t getPtr(int r)               { return data[r] | (data[r + 1] << 8); }
+static void setPtr(int r, uint16_t v)       { data[r] = v & 0xff; data[r + 1] = v >> 8; }
+
+static void skip(void)
+{
+    uint16_t next = flash[2 * pc] | (flash[2 * pc + 1] << 8);
+
+    if (isTwoWord(next)) {
+        pc += 2;
+        cycles += 2;
+    } else {
+        pc += 1;
+        cycles += 1;
+    }
+}
+
+static void recordWindow(uint32_t startpc, uint32_t endpc, uint64_t length)
+{
+    unsigned i;
+
+    for (i = 0; i < nwindows; i++)
+        if ((windows[i].startpc == startpc) && (windows[i].endpc == endpc))
+            break;
+    if (i == nwindows) {
+        if (nwindows == MAXWINDOWS) {
+            lostwindows++;
+            return;
+        }
+        memset(&windows[nwindows++], 0, sizeof(struct window));
+        windows[i].startpc = startpc;
+        windows[i].endpc = endpc;
+    }
+    if (length > windows[i].max)
+        windows[i].max = length;
+    windows[i].total += length;
+    windows[i].count++;
+}
+
+/* called after each instruction at "at" */
+static void trackIrq(uint32_t at)
+{
+    int iflag = BIT(data[ADDR_SREG], SREG_I);
+
+    if (irqstate == IRQ_CLOSING) {              /* the instruction after sei/reti is done */
+        if (iflag) {
+            recordWindow(irqoffpc, at, cycles - irqoffsince);
+            irqstate = IRQ_ON;
+        } else {
+            irqstate = IRQ_OFF;                 /* e.g. "sei" "cli": no interrupt taken */
+        }
+    } else if (irqstate == IRQ_ON) {
+        if (!iflag) {
+            irqstate = IRQ_OFF;
+            irqoffsince = cycles;
+            irqoffpc = at;
+        } else if (haltcycles) {
+            recordWindow(at, at, haltcycles);
+        }
+    } else if (iflag) {
+        irqstate = IRQ_CLOSING;
+    }
+    haltcycles = 0;
+}
+
+static void step(void)
+{
+    uint32_t    at = pc;
+    uint16_t    op = flash[2 * pc] | (flash[2 * pc + 1] << 8);
+    uint16_t    op2 = flash[2 * pc + 2] | (flash[2 * pc + 3] << 8);
+    uint64_t    start = cycles;
+    struct symbol *sym;
+    int         d = (op >> 4) & 0x1f, r = (op & 0x0f) | ((op >> 5) & 0x10);
+    int         dh = 16 + ((op >> 4) & 0x0f);
+    uint8_t     K = (op & 0x0f) | ((op >> 4) & 0xf0);
+    uint8_t     v;
+    int32_t     rel;
+
+    pc++;
+    cycles++;
+
+    if (op == 0x0000) {                                 /* nop */
+    } else if ((op & 0xff00) == 0x0100) {               /* movw */
+        data[2 * ((op >> 4) & 0x0f)]     = data[2 * (op & 0x0f)];
+        data[2 * ((op >> 4) & 0x0f) + 1] = data[2 * (op & 0x0f) + 1];
+    } else if ((op & 0xff00) == 0x0200) {               /* muls */
+        doMul((int8_t)data[dh] * (int8_t)data[16 + (op & 0x0f)], 0);
+        cycles++;
+    } else if ((op & 0xff88) == 0x0300) {               /* mulsu */
+        doMul((int8_t)data[16 + ((op >> 4) & 7)] * (uint8_t)data[16 + (op & 7)], 0);
+        cycles++;
+    } else if ((op & 0xff88) == 0x0308) {               /* fmul */
+        doMul((uint8_t)data[16 + ((op >> 4) & 7)] * (uint8_t)data[16 + (op & 7)], 1);
+        cycles++;
+    } else if ((op & 0xff88) == 0x0380) {               /* fmuls */
+        doMul((int8_t)data[16 + ((op >> 4) & 7)] * (int8_t)data[16 + (op & 7)], 1);
+        cycles++;
+    } else if ((op & 0xff88) == 0x0388) {               /* fmulsu */
+        doMul((int8_t)data[16 + ((op >> 4) & 7)] * (uint8_t)data[16 + (op & 7)], 1);
+        cycles++;
+    } else if ((op & 0xfc00) == 0x0400) {               /* cpc */
+        doSub(data[d], data[r], BIT(SREG, SREG_C), 1);
+    } else if ((op & 0xfc00) == 0x0800) {               /* sbc */
+        data[d] = doSub(data[d], data[r], BIT(SREG, SREG_C), 1);
+    } else if ((op & 0xfc00) == 0x0c00) {               /* add */
+        data[d] = doAdd(data[d], data[r], 0);
+    } else if ((op & 0xfc00) == 0x1000) {               /* cpse */
+        if (data[d] == data[r])
+            skip();
+    } else if ((op & 0xfc00) == 0x1400) {               /* cp */
+        doSub(data[d], data[r], 0, 0);
+    } else if ((op & 0xfc00) == 0x1800) {               /* sub */
+        data[d] = doSub(data[d], data[r], 0, 0);
+    } else if ((op & 0xfc00) == 0x1c00) {               /* adc */
+        data[d] = doAdd(data[d], data[r], BIT(SREG, SREG_C));
+    } else if ((op & 0xfc00) == 0x2000) {               /* and */
+        data[d] = doLogic(data[d] & data[r]);
+    } else if ((op & 0xfc00) == 0x2400) {               /* eor */
+        data[d] = doLogic(data[d] ^ data[r]);
+    } else if ((op & 0xfc00) == 0x2800) {               /* or */
+        data[d] = doLogic(data[d] | data[r]);
+    } else if ((op & 0xfc00) == 0x2c00) {               /* mov */
+        data[d] = data[r];
+    } else if ((op & 0xf000) == 0x3000) {               /* cpi */
+        doSub(data[dh], K, 0, 0);
+    } else if ((op & 0xf000) == 0x4000) {               /* sbci */
+        data[dh] = doSub(data[dh], K, BIT(SREG, SREG_C), 1);
+    } else if ((op & 0xf000) == 0x5000) {               /* subi */
+        data[dh] = doSub(data[dh], K, 0, 0);
+    } else if ((op & 0xf000) == 0x6000) {               /* ori */
+        data[dh] = doLogic(data[dh] | K);
+    } else if ((op & 0xf000) == 0x7000) {               /* andi */
+        data[dh] = doLogic(data[dh] & K);
+    } else if ((op & 0xd000) == 0x8000) {               /* ldd/std y+q, z+q */
+        int q = (op & 7) | ((op >> 7) & 0x18) | ((op >> 8) & 0x20);
+        uint16_t a = getPtr((op & 0x08) ? 28 : 30) + q;
+        if (op & 0x0200)
+            writeData(a, data[d]);
+        else
+            data[d] = readData(a);
+        cycles++;
+    } else if ((op & 0xfc00) == 0x9000) {               /* lds/ld/lpm/elpm/pop, sts/st/push */
+        int store = op & 0x0200;
+        int mode = op & 0x0f;
+        int ptr;
+        uint16_t a;
+
+        if (mode == 0x0) {                              /* lds/sts */
+            pc++;
+            if (store)
+                writeData(op2, data[d]);
+            else
+                data[d] = readData(op2);
+            cycles++;
+        } else if (!store && ((mode & 0x0c) == 0x04)) { /* lpm/elpm rd, z(+) */
+            uint32_t z = getZ(mode & 0x02);
+            data[d] = readFlash(z);
+            if (mode & 0x01) {
+                z++;
+                setPtr(30, z & 0xffff);
+                if ((mode & 0x02) && (dev->rampz >= 0))
+                    data[dev->rampz] = z >> 16;
+            }
+            cycles += 2;
+        } else if (mode == 0x0f) {                      /* pop/push */
+            if (store)
+                push(data[d]);
+            else
+                data[d] = pop();
+            cycles++;
+        } else {
+            switch (mode) {
+            case 0x1: case 0x2:   ptr = 30; break;
+            case 0x9: case 0xa:   ptr = 28; break;
+            case 0xc: case 0xd: case 0xe: ptr = 26; break;
+            default:
+                fprintf(stderr, "unsupported instruction 0x%04x at 0x%05x\n", op, 2 * at);
+                stopped = 1;
+                return;
+            }
+            a = getPtr(ptr);
+            if ((mode & 3) == 2)                        /* pre-decrement */
+                setPtr(ptr, --a);
+            if (store)
+                writeData(a, data[d]);
+            else
+                data[d] = readData(a);
+            if ((mode & 3) == 1)                        /* post-increment */
+                setPtr(ptr, a + 1);
+            cycles++;
+        }
+    } else if (((op & 0xfe00) == 0x9400) && ((((op & 0x0f) <= 7) && ((op & 0x0f) != 4)) || ((op & 0x0f) == 0x0a))) {
+        switch (op & 0x0f) {                            /* one operand instructions */
+        case 0x0:                                       /* com */
+            data[d] = doLogic(~data[d]);
+            setFlag(SREG_C, 1);
+            break;
+        case 0x1:                                       /* neg */
+            data[d] = doSub(0, data[d], 0, 0);
+            break;
+        case 0x2:                                       /* swap */
+            data[d] = (data[d] << 4) | (data[d] >> 4);
+            break;
+        case 0x3:                                       /* inc */
+            data[d]++;
+            setFlag(SREG_V, data[d] == 0x80);
+            setNZS(data[d]);
+            break;
+        case 0x5: case 0x6: case 0x7:                   /* asr, lsr, ror */
+            v = data[d];
+            if ((op & 0x0f) == 0x5)
+                data[d] = (v >> 1) | (v & 0x80);
+            else if ((op & 0x0f) == 0x6)
+                data[d] = v >> 1;
+            else
+                data[d] = (v >> 1) | (BIT(SREG, SREG_C) << 7);
+            setFlag(SREG_C, v & 1);
+            setFlag(SREG_N, BIT(data[d], 7));
+            setFlag(SREG_V, BIT(SREG, SREG_N) ^ BIT(SREG, SREG_C));
+            setNZS(data[d]);
+            break;
+        case 0xa:                                       /* dec */
+            data[d]--;
+            setFlag(SREG_V, data[d] == 0x7f);
+            setNZS(data[d]);
+            break;
+        default:
+            fprintf(stderr, "unsupported instruction 0x%04x at 0x%05x\n", op, 2 * at);
+            stopped = 1;
+            return;
+        }
+    } else if ((op & 0xfe0c) == 0x940c) {               /* jmp, call */
+        uint32_t k = ((uint32_t)(((op >> 3) & 0x3e) | (op & 1)) << 16) | op2;
+        pc++;
+        if (op & 0x02) {
+            pushPc(pc);
+            cycles += (pcbytes > 2) ? 4 : 3;
+        } else {
+            cycles += 2;
+        }
+        pc = k;
+    } else if ((op & 0xff8f) == 0x9408) {               /* bset */
+        SREG |= 1 << ((op >> 4) & 7);
+    } else if ((op & 0xff8f) == 0x9488) {               /* bclr */
+        SREG &= ~(1 << ((op >> 4) & 7));
+    } else if ((op == 0x9508) || (op == 0x9518)) {      /* ret, reti */
+        pc = popPc();
+        cycles += (pcbytes > 2) ? 4 : 3;
+        if (op == 0x9518)
+            SREG |= 1 << SREG_I;
+    } else if (op == 0x9588) {                          /* sleep */
+    } else if (op == 0x9598) {                          /* break */
+        fprintf(stderr, "break at 0x%05x\n", 2 * at);
+        stopped = 1;
+    } else if (op == 0x95a8) {                          /* wdr */
+        wdrcount++;
+    } else if ((op == 0x95c8) || (op == 0x95d8)) {      /* lpm, elpm (r0) */
+        data[0] = readFlash(getZ(op == 0x95d8));
+        cycles += 2;
+    } else if (op == 0x95e8) {                          /* spm */
+        doSpm();
+    } else if ((op == 0x9409) || (op == 0x9419)) {      /* ijmp, eijmp */
+        pc = getPtr(30) | (((op == 0x9419) && (dev->eind >= 0)) ? ((uint32_t)data[dev->eind] << 16) : 0);
+        cycles++;
+    } else if ((op == 0x9509) || (op == 0x9519)) {      /* icall, eicall */
+        pushPc(pc);
+        pc = getPtr(30) | (((op == 0x9519) && (dev->eind >= 0)) ? ((uint32_t)data[dev->eind] << 16) : 0);
+        cycles += (pcbytes > 2) ? 3 : 2;
+    } else if ((op & 0xfe00) == 0x9600) {               /* adiw, sbiw */
+        int         rd = 24 + ((op >> 3) & 0x06);
+        uint16_t    a = getPtr(rd), k = (op & 0x0f) | ((op >> 2) & 0x30), res;
+
+        if (op & 0x0100) {
+            res = a - k;
+            setFlag(SREG_V, BIT(a, 15) & NBIT(res, 15));
+            setFlag(SREG_C, BIT(res, 15) & NBIT(a, 15));
+        } else {
+            res = a + k;
+            setFlag(SREG_V, NBIT(a, 15) & BIT(res, 15));
+            setFlag(SREG_C, NBIT(res, 15) & BIT(a, 15));
+        }
+        setPtr(rd, res);
+        setFlag(SREG_N, BIT(res, 15));
+        setFlag(SREG_Z, res == 0);
+        setFlag(SREG_S, BIT(SREG, SREG_N) ^ BIT(SREG, SREG_V));
+        cycles++;
+    } else if ((op & 0xfc00) == 0x9800) {               /* cbi, sbic, sbi, sbis */
+        uint16_t    a = 0x20 + ((op >> 3) & 0x1f);
+        int         b = op & 7;
+
+        switch ((op >> 8) & 3) {
+        case 0: writeData(a, readData(a) & ~(1 << b)); cycles++; break;
+        case 1: if (NBIT(readData(a), b)) skip(); break;
+        case 2: writeData(a, readData(a) | (1 << b)); cycles++; break;
+        case 3: if (BIT(readData(a), b)) skip(); break;
+        }
+    } else if ((op & 0xfc00) == 0x9c00) {               /* mul */
+        doMul((uint8_t)data[d] * (uint8_t)data[r], 0);
+        cycles++;
+    } else if ((op & 0xf000) == 0xb000) {               /* in, out */
+        uint16_t a = 0x20 + ((op & 0x0f) | ((op >> 5) & 0x30));
+        if (op & 0x0800)
+            writeData(a, data[d]);
+        else
+            data[d] = readData(a);
+    } else if ((op & 0xe000) == 0xc000) {               /* rjmp, rcall */
+        rel = op & 0x0fff;
+        if (rel & 0x0800)
+            rel -= 0x1000;
+        if (op & 0x1000) {
+            pushPc(pc);
+            cycles += (pcbytes > 2) ? 3 : 2;
+        } else {
+            cycles++;
+        }
+        pc = (pc + rel) % (dev->flashsize / 2);
+    } else if ((op & 0xf000) == 0xe000) {               /* ldi */
+        data[dh] = K;
+    } else if ((op & 0xf800) == 0xf000) {               /* brbs, brbc */
+        rel = (op >> 3) & 0x7f;
+        if (rel & 0x40)
+            rel -= 0x80;
+        if (BIT(SREG, op & 7) == !(op & 0x0400)) {
+            pc += rel;
+            cycles++;
+        }
+    } else if ((op & 0xfe08) == 0xf800) {               /* bld */
+        data[d] = (data[d] & ~(1 << (op & 7))) | (BIT(SREG, SREG_T) << (op & 7));
+    } else if ((op & 0xfe08) == 0xfa00) {               /* bst */
+        setFlag(SREG_T, BIT(data[d], op & 7));
+    } else if ((op & 0xfc08) == 0xfc00) {               /* sbrc, sbrs */
+        if (BIT(data[d], op & 7) == !!(op & 0x0200))
+            skip();
+    } else {
+        fprintf(stderr, "unsupported instruction 0x%04x at 0x%05x\n", op, 2 * at);
+        stopped = 1;
+        return;
+    }
+
+    /* time passes for pending SPM and EEPROM operations */
+    if (spmbusy)
+        spmbusy = (spmbusy > cycles - start) ? spmbusy - (cycles - start) : 0;
+    if (eebusy)
+        eebusy = (eebusy > cycles - start) ? eebusy - (cycles - start) : 0;
+
+    sym = symbolAt(2 * at);
+    if (sym)
+        sym->cycles += cycles - start;
+    trackIrq(at);
+}
+
+/* ------------------------------------------------------------------------ */
+/*                             script engine                                */
+/* ------------------------------------------------------------------------ */
+
+static void setSp(uint16_t sp)
+{
+    data[ADDR_SPL] = sp & 0xff;
+    data[ADDR_SPH] = sp >> 8;
+}
+
+/*
+ * run until pc reaches "until" (word address) with the stack pointer at
+ * "sp" (-1: any), returns cycles used
+ */
+static uint64_t runUntil(uint32_t until, int sp, uint64_t maxcycles)
+{
+    uint64_t begin = cycles;
+
+    stopped = 0;
+    while (((pc != until) || ((sp >= 0) && ((data[ADDR_SPL] | (data[ADDR_SPH] << 8)) != sp))) && (!stopped)) {
+        if (pc >= dev->flashsize / 2) {
+            fprintf(stderr, "pc 0x%05x outside of flash\n", 2 * pc);
+            stopped = 1;
+            break;
+        }
+        if (cycles - begin > maxcycles) {
+            fprintf(stderr, "no return after %llu cycles (pc 0x%05x)\n", (unsigned long long)maxcycles, 2 * pc);
+            stopped = 1;
+            break;
+        }
+        step();
+    }
+    return cycles - begin;
+}
+
+static int parseAddr(const char *s, uint32_t *addr, uint32_t *size)
+{
+    struct symbol *sym;
+    char *end;
+
+    *size = 1;
+    *addr = strtoul(s, &end, 0);
+    if (*end == 0)
+        return 0;
+    sym = findSymbol(s, 0);
+    if (sym == NULL) {
+        fprintf(stderr, "unknown symbol \"%s\"\n", s);
+        return -1;
+    }
+    *addr = sym->addr;
+    *size = sym->size ? sym->size : 1;
+    return 0;
+}
+
+static int parseHex(const char *s, uint8_t *buf, unsigned max)
+{
+    unsigned n = 0, v;
+
+    while (s[0] && s[1] && (n < max)) {
+        if (sscanf(s, "%2x", &v) != 1)
+            return -1;
+        buf[n++] = v;
+        s += 2;
+    }
+    return n;
+}
+
+static const char *location(uint32_t wordpc)
+{
+    static char     buf[2][96];
+    static int      n;
+    char            *b = buf[n++ & 1];
+    struct symbol   *sym;
+
+    if (wordpc == PC_RETURN)
+        return "(return)";
+    sym = symbolAt(2 * wordpc);
+    if (sym)
+        snprintf(b, sizeof(buf[0]), "%s+0x%x", sym->name, 2 * wordpc - sym->addr);
+    else
+        snprintf(b, sizeof(buf[0]), "0x%05x", 2 * wordpc);
+    return b;
+}
+
+static int windowcmp(const void *a, const void *b)
+{
+    const struct window *x = a, *y = b;
+
+    return (x->max < y->max) - (x->max > y->max);
+}
+
+static void printIrq(void)
+{
+    unsigned i;
+
+    qsort(windows, nwindows, sizeof(struct window), windowcmp);
+    printf("interrupt blocking windows (budget %.0f cycles):\n", budget);
+    printf("%10s %9s %8s %10s  %s\n", "max", "max[us]", "count", "avg", "from -> to");
+    for (i = 0; i < nwindows; i++) {
+        printf("%10llu %9.2f %8lu %10.1f  %s -> %s%s\n", (unsigned long long)windows[i].max,
+               windows[i].max * 1000000.0 / fcpu, windows[i].count, (double)windows[i].total / windows[i].count,
+               location(windows[i].startpc), location(windows[i].endpc),
+               (windows[i].max > budget) ? "   !!! exceeds budget" : "");
+    }
+    if (lostwindows)
+        printf("(%lu windows not recorded, table full)\n", lostwindows);
+    nwindows = 0;
+    lostwindows = 0;
+}
+
+/* start tracking interrupt windows at "wordpc" according to the current I flag */
+static void irqStart(uint32_t wordpc)
+{
+    irqstate = BIT(data[ADDR_SREG], SREG_I) ? IRQ_ON : IRQ_OFF;
+    irqoffsince = cycles;
+    irqoffpc = wordpc;
+}
+
+static void irqStop(void)
+{
+    if (irqstate != IRQ_ON)
+        recordWindow(irqoffpc, PC_RETURN, cycles - irqoffsince);
+}
+
+static void printProfile(void)
+{
+    uint64_t    total = 0;
+    unsigned    i;
+
+    for (i = 0; i < ntextsyms; i++)
+        total += textsyms[i].cycles;
+    printf("%12s %6s  %s\n", "cycles", "%", "function");
+    for (i = 0; i < ntextsyms; i++) {
+        if (textsyms[i].cycles == 0)
+            continue;
+        printf("%12llu %6.2f  %s\n", (unsigned long long)textsyms[i].cycles,
+               total ? 100.0 * textsyms[i].cycles / total : 0.0, textsyms[i].name);
+        textsyms[i].cycles = 0;
+    }
+    printf("%12llu          total, %lu spm, %lu wdr\n", (unsigned long long)total, spmcount, wdrcount);
+}
+
+static void doCall(char **argv, int argc)
+{
+    struct symbol   *func = findSymbol(argv[1], 1);
+    uint32_t        sentinel = dev->flashsize / 2;      /* first word address beyond flash */
+    uint16_t        scratch = dev->ramend - 0x180;      /* pointer arguments go here */
+    uint64_t        used;
+    int             i;
+
+    if (func == NULL) {
+        fprintf(stderr, "unknown function \"%s\"\n", argv[1]);
+        return;
+    }
+    setSp(scratch - 1);                                 /* stack grows down from below the scratch buffer */
+    for (i = 2; (i < argc) && (i < 11); i++) {
+        uint16_t    v;
+        uint32_t    size;
+        int         reg = 24 - 2 * (i - 2);
+
+        if (argv[i][0] == '@') {
+            int n = parseHex(argv[i] + 1, data + scratch, 0x100);
+            if (n < 0) {
+                fprintf(stderr, "bad hex argument \"%s\"\n", argv[i]);
+                return;
+            }
+            v = scratch;
+            scratch += n;
+        } else if (argv[i][0] == '&') {
+            uint32_t a;
+            if (parseAddr(argv[i] + 1, &a, &size) != 0)
+                return;
+            v = a;
+        } else {
+            v = strtoul(argv[i], NULL, 0);
+        }
+        data[reg] = v & 0xff;
+        data[reg + 1] = v >> 8;
+    }
+    data[1] = 0;                                        /* __zero_reg__ */
+    /*
+     * With 128K flash (ATmega1284p) the 16 bit return address wraps to 0:
+     * the call is over when pc gets there with the stack back at "scratch".
+     */
+    if (pcbytes == 2)
+        sentinel &= 0xffff;
+    pushPc(sentinel);
+    pc = func->addr / 2;
+    irqStart(pc);
+    used = runUntil(sentinel, scratch - 1, MAXCALLCYCLES);
+    irqStop();
+    printf("call %-32s %10llu cycles (%.1f us)  -> r24 0x%02x r25 0x%02x\n", argv[1],
+           (unsigned long long)used, used * 1000000.0 / fcpu, data[24], data[25]);
+}
+
+static void runScript(FILE *in, uint32_t entry)
+{
+    char line[1024];
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        char    *argv[16], *p;
+        int     argc = 0;
+
+        if ((p = strchr(line, '#')) != NULL)
+            *p = 0;
+        for (p = strtok(line, " \t\r\n"); p && (argc < 16); p = strtok(NULL, " \t\r\n"))
+            argv[argc++] = p;
+        if (argc == 0)
+            continue;
+
+        if (strcmp(argv[0], "init") == 0) {
+            struct symbol *until = findSymbol((argc > 1) ? argv[1] : "main", 1);
+            uint64_t used;
+
+            if (until == NULL) {
+                fprintf(stderr, "unknown symbol \"%s\"\n", (argc > 1) ? argv[1] : "main");
+                continue;
+            }
+            memset(data, 0, sizeof(data));
+            setSp(dev->ramend);
+            pc = entry / 2;
+            irqStart(pc);
+            used = runUntil(until->addr / 2, -1, MAXCALLCYCLES);
+            irqStop();
+            printf("init until %-26s %10llu cycles\n", until->name, (unsigned long long)used);
+        } else if ((strcmp(argv[0], "call") == 0) && (argc > 1)) {
+            doCall(argv, argc);
+        } else if ((strcmp(argv[0], "set") == 0) && (argc > 2)) {
+            uint32_t addr, size;
+            int i, n;
+
+            if (parseAddr(argv[1], &addr, &size) != 0)
+                continue;
+            for (i = 2; i < argc; i++) {
+                n = parseHex(argv[i], data + addr, sizeof(data) - addr);
+                if (n < 0)
+                    break;
+                addr += n;
+            }
+        } else if ((strcmp(argv[0], "print") == 0) && (argc > 1)) {
+            uint32_t addr, size, i;
+
+            if (parseAddr(argv[1], &addr, &size) != 0)
+                continue;
+            if (argc > 2)
+                size = strtoul(argv[2], NULL, 0);
+            printf("%s:", argv[1]);
+            for (i = 0; i < size; i++)
+                printf(" %02x", data[(addr + i) & 0xffff]);
+            putchar('\n');
+        } else if ((strcmp(argv[0], "flash") == 0) && (argc > 1)) {
+            uint32_t addr = strtoul(argv[1], NULL, 0), n = (argc > 2) ? strtoul(argv[2], NULL, 0) : 16, i;
+
+            printf("flash 0x%05x:", addr);
+            for (i = 0; i < n; i++)
+                printf(" %02x", flash[(addr + i) % dev->flashsize]);
+            putchar('\n');
+        } else if (strcmp(argv[0], "profile") == 0) {
+            printProfile();
+        } else if ((strcmp(argv[0], "load") == 0) && (argc > 1)) {
+            loadElf(argv[1]);
+        } else if (strcmp(argv[0], "sei") == 0) {
+            data[ADDR_SREG] |= 1 << SREG_I;
+        } else if (strcmp(argv[0], "cli") == 0) {
+            data[ADDR_SREG] &= ~(1 << SREG_I);
+        } else if (strcmp(argv[0], "irq") == 0) {
+            printIrq();
+        } else {
+            fprintf(stderr, "unknown command \"%s\"\n", argv[0]);
+        }
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s -m mcu [-f F_CPU] [-t flash-ms] [-w cycles] [-l] file.elf [script]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char  *elf = NULL, *script = NULL, *mcu = NULL;
+    double      flashms = 4.0;
+    FILE        *in = stdin;
+    uint32_t    entry;
+    unsigned    i;
+    int         c;
+
+    for (c = 1; c < argc; c++) {
+        if (!strcmp(argv[c], "-m") && (c + 1 < argc)) {
+            mcu = argv[++c];
+        } else if (!strcmp(argv[c], "-f") && (c + 1 < argc)) {
+            fcpu = atof(argv[++c]);
+        } else if (!strcmp(argv[c], "-t") && (c + 1 < argc)) {
+            flashms = atof(argv[++c]);
+        } else if (!strcmp(argv[c], "-w") && (c + 1 < argc)) {
+            budget = atof(argv[++c]);
+        } else if (!strcmp(argv[c], "-l")) {
+            withlabels = 1;
+        } else if (argv[c][0] == '-') {
+            usage(argv[0]);
+        } else if (elf == NULL) {
+            elf = argv[c];
+        } else if (script == NULL) {
+            script = argv[c];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if ((elf == NULL) || (mcu == NULL) || (fcpu <= 0) || (flashms < 0))
+        usage(argv[0]);
+    for (i = 0; i < sizeof(devices) / sizeof(devices[0]); i++)
+        if (!strcmp(devices[i].name, mcu))
+            dev = &devices[i];
+    if (dev == NULL) {
+        fprintf(stderr, "unknown mcu \"%s\", known:", mcu);
+        for (i = 0; i < sizeof(devices) / sizeof(devices[0]); i++)
+            fprintf(stderr, " %s", devices[i].name);
+        fputc('\n', stderr);
+        return 2;
+    }
+    pcbytes = (dev->flashsize > 131072) ? 3 : 2;
+    flashopcycles = (uint64_t)(fcpu * flashms / 1000.0);
+    if (budget <= 0)
+        budget = 25.0 * fcpu / 12000000.0;
+    memset(flash, 0xff, sizeof(flash));
+    memset(eeprom, 0xff, sizeof(eeprom));
+    memset(pagebuf, 0xff, sizeof(pagebuf));
+
+    entry = loadElf(elf);
+    if (script) {
+        in = fopen(script, "r");
+        if (in == NULL) {
+            perror(script);
+            return 1;
+        }
+    }
+    runScript(in, entry);
+    if (in != stdin)
+        fclose(in);
+    return 0;
+}
@@ -0,0 +1,183 @@
+/* Name: imagemac.c
+ * Project: USBaspLoader
+ * Creation Date: 2026-10-18
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ */
+
+/*
+ * Computes length and MAC of an Intel HEX firmware image for a bootloader
+ * built with HAVE_IMAGEAUTH (see "firmware/appinterface.h" for the format).
+ * The host announces both with vendor request 75 (wValue/wIndex: length,
+ * OUT data: the 8 MAC bytes as printed) and then writes the image from
+ * address 0 up to "length" in ascending order without skipping pages (the
+ * last page may be padded with 0xff, as avrdude does).
+ *
+ * Usage: imagemac -k key0,key1,key2,key3 in.hex
+ *     e.g.: imagemac -k 0x01234567,0x89abcdef,0xfedcba98,0x76543210 main.hex
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "../firmware/appinterface.h"
+
+#define FLASH_MAX   (256UL * 1024UL)
+
+static uint8_t  flash[FLASH_MAX];
+static uint8_t  used[FLASH_MAX];
+static uint32_t key[4];
+
+static unsigned hexByte(const char *s)
+{
+    unsigned v;
+
+    if (sscanf(s, "%2x", &v) != 1)
+        return 0x100;
+    return v;
+}
+
+static int readHex(const char *name)
+{
+    FILE            *f = fopen(name, "r");
+    char            line[600];
+    unsigned long   base = 0;
+    unsigned        lineno = 0;
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned    n, addr, type, i, sum = 0, b[256];
+
+        lineno++;
+        if (line[0] != ':')
+            continue;
+        n = hexByte(line + 1);
+        if ((n > 255) || (strlen(line) < 11 + 2 * n)) {
+            fprintf(stderr, "%s:%u: malformed record\n", name, lineno);
+            fclose(f);
+            return -1;
+        }
+        for (i = 0; i < n + 5; i++) {
+            b[i] = hexByte(line + 1 + 2 * i);
+            sum += b[i];
+        }
+        if (sum & 0xff) {
+            fprintf(stderr, "%s:%u: checksum error\n", name, lineno);
+            fclose(f);
+            return -1;
+        }
+        addr = (b[1] << 8) | b[2];
+        type = b[3];
+        if (type == 0x00) {
+            for (i = 0; i < n; i++) {
+                unsigned long a = base + addr + i;
+                if (a >= FLASH_MAX) {
+                    fprintf(stderr, "%s:%u: address 0x%lx out of range\n", name, lineno, a);
+                    fclose(f);
+                    return -1;
+                }
+                flash[a] = b[4 + i];
+                used[a] = 1;
+            }
+        } else if (type == 0x01) {
+            break;
+        } else if (type == 0x02) {
+            base = ((unsigned long)((b[4] << 8) | b[5])) << 4;
+        } else if (type == 0x04) {
+            base = ((unsigned long)((b[4] << 8) | b[5])) << 16;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* same as imageAuthEncrypt() in "firmware/main.c" */
+static void encrypt(uint32_t chain[2], const uint8_t block[8])
+{
+    uint32_t    v0 = chain[0] ^ get32(block), v1 = chain[1] ^ get32(block + 4), sum = 0;
+    int         i;
+
+    for (i = 0; i < 32; i++) {
+        v0  += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + key[sum & 3]);
+        sum += 0x9e3779b9;
+        v1  += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + key[(sum >> 11) & 3]);
+    }
+    chain[0] = v0;
+    chain[1] = v1;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s -k key0,key1,key2,key3 in.hex\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long   length = 0, a;
+    uint32_t        chain[2] = { 0, 0 };
+    uint8_t         block[8];
+    const char      *in = NULL;
+    int             c, havekey = 0;
+
+    for (c = 1; c < argc; c++) {
+        if ((strcmp(argv[c], "-k") == 0) && (c + 1 < argc)) {
+            char *s = argv[++c], *e;
+            int  i;
+
+            for (i = 0; i < 4; i++) {
+                key[i] = strtoul(s, &e, 0);
+                if ((e == s) || ((i < 3) && (*e != ',')) || ((i == 3) && (*e != '\0')))
+                    usage(argv[0]);
+                s = e + 1;
+            }
+            havekey = 1;
+        } else if (in == NULL) {
+            in = argv[c];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if ((in == NULL) || (!havekey))
+        usage(argv[0]);
+    if (readHex(in) != 0)
+        return 1;
+
+    for (a = 0; a < FLASH_MAX; a++)
+        if (used[a])
+            length = a + 1;
+    if (length == 0) {
+        fprintf(stderr, "%s: no data\n", in);
+        return 1;
+    }
+    length = (length + 1) & ~1UL;
+
+    /* prefix: appimageauthprefix_t */
+    for (c = 0; c < 4; c++) {
+        block[c]     = (length >> (8 * c)) & 0xff;
+        block[c + 4] = ((uint32_t)APPIMAGEAUTH_MAGIC >> (8 * c)) & 0xff;
+    }
+    encrypt(chain, block);
+    /* image, gaps and padding read as erased flash */
+    for (a = 0; a < length; a += 8) {
+        for (c = 0; c < 8; c++)
+            block[c] = ((a + c < length) && used[a + c]) ? flash[a + c] : 0xff;
+        encrypt(chain, block);
+    }
+
+    printf("length: %lu (0x%05lx)\nmac:   ", length, length);
+    for (c = 0; c < 8; c++)
+        printf(" %02x", (unsigned)((chain[c >> 2] >> (8 * (c & 3))) & 0xff));
+    printf("\n");
+    return 0;
+}
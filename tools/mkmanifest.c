@@ -0,0 +1,274 @@
+/* Name: mkmanifest.c
+ * Project: USBaspLoader
+ * Creation Date: 2026-10-18
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ */
+
+/*
+ * Adds an application manifest (see "firmware/appinterface.h") to an
+ * Intel HEX firmware image for a bootloader built with HAVE_APPMANIFEST.
+ *
+ * The manifest is placed into the page right below the bootloader. Used
+ * flash is described by page aligned segments - if the image has more
+ * gaps than APPMANIFEST_MAXSEGMENTS allows, the smallest gaps are merged.
+ *
+ * Usage: mkmanifest -b bootloader-address [-p pagesize] in.hex out.hex
+ *     e.g.: mkmanifest -b 0x3e000 -p 256 main.hex main-manifest.hex
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "../firmware/appinterface.h"
+
+#define FLASH_MAX   (256UL * 1024UL)
+
+static uint8_t  flash[FLASH_MAX];
+static uint8_t  used[FLASH_MAX];
+
+/* same as avr-libc's _crc16_update() */
+static uint16_t crc16Update(uint16_t crc, uint8_t a)
+{
+    int i;
+
+    crc ^= a;
+    for (i = 0; i < 8; i++)
+        crc = (crc & 1) ? ((crc >> 1) ^ 0xa001) : (crc >> 1);
+    return crc;
+}
+
+static unsigned hexByte(const char *s)
+{
+    unsigned v;
+
+    if (sscanf(s, "%2x", &v) != 1)
+        return 0x100;
+    return v;
+}
+
+static int readHex(const char *name)
+{
+    FILE            *f = fopen(name, "r");
+    char            line[600];
+    unsigned long   base = 0;
+    unsigned        lineno = 0;
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned    n, addr, type, i, sum = 0, b[256];
+
+        lineno++;
+        if (line[0] != ':')
+            continue;
+        n = hexByte(line + 1);
+        if ((n > 255) || (strlen(line) < 11 + 2 * n)) {
+            fprintf(stderr, "%s:%u: malformed record\n", name, lineno);
+            fclose(f);
+            return -1;
+        }
+        for (i = 0; i < n + 5; i++) {
+            b[i] = hexByte(line + 1 + 2 * i);
+            sum += b[i];
+        }
+        if (sum & 0xff) {
+            fprintf(stderr, "%s:%u: checksum error\n", name, lineno);
+            fclose(f);
+            return -1;
+        }
+        addr = (b[1] << 8) | b[2];
+        type = b[3];
+        if (type == 0x00) {
+            for (i = 0; i < n; i++) {
+                unsigned long a = base + addr + i;
+                if (a >= FLASH_MAX) {
+                    fprintf(stderr, "%s:%u: address 0x%lx out of range\n", name, lineno, a);
+                    fclose(f);
+                    return -1;
+                }
+                flash[a] = b[4 + i];
+                used[a] = 1;
+            }
+        } else if (type == 0x01) {
+            break;
+        } else if (type == 0x02) {
+            base = ((unsigned long)((b[4] << 8) | b[5])) << 4;
+        } else if (type == 0x04) {
+            base = ((unsigned long)((b[4] << 8) | b[5])) << 16;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static void writeRecord(FILE *f, unsigned n, unsigned addr, unsigned type, const uint8_t *data)
+{
+    unsigned i, sum = n + (addr >> 8) + (addr & 0xff) + type;
+
+    fprintf(f, ":%02X%04X%02X", n, addr & 0xffff, type);
+    for (i = 0; i < n; i++) {
+        fprintf(f, "%02X", data[i]);
+        sum += data[i];
+    }
+    fprintf(f, "%02X\n", (-sum) & 0xff);
+}
+
+static int writeHex(const char *name)
+{
+    FILE            *f = fopen(name, "w");
+    unsigned long   a, base = 0;
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    for (a = 0; a < FLASH_MAX; a += 16) {
+        unsigned i, n = 0;
+
+        for (i = 0; i < 16; i++)
+            if (used[a + i])
+                n = i + 1;
+        if (n == 0)
+            continue;
+        if ((a >> 16) != base) {
+            uint8_t seg[2];
+            base = a >> 16;
+            seg[0] = base >> 8;
+            seg[1] = base & 0xff;
+            writeRecord(f, 2, 0, 0x04, seg);
+        }
+        writeRecord(f, n, a & 0xffff, 0x00, flash + a);
+    }
+    writeRecord(f, 0, 0, 0x01, NULL);
+    fclose(f);
+    return 0;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, v & 0xffff);
+    put16(p + 2, v >> 16);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s -b bootloader-address [-p pagesize] in.hex out.hex\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long           bootaddr = 0, pagesize = 128, manaddr, a, start[FLASH_MAX / 32], end[FLASH_MAX / 32];
+    unsigned                nseg = 0, i, pages = 0;
+    uint32_t                length = 0;
+    uint16_t                crc = 0xffff;
+    uint8_t                 m[sizeof(appmanifest_t)];
+    const char              *in = NULL, *out = NULL;
+    int                     c;
+
+    for (c = 1; c < argc; c++) {
+        if ((strcmp(argv[c], "-b") == 0) && (c + 1 < argc)) {
+            bootaddr = strtoul(argv[++c], NULL, 0);
+        } else if ((strcmp(argv[c], "-p") == 0) && (c + 1 < argc)) {
+            pagesize = strtoul(argv[++c], NULL, 0);
+        } else if (in == NULL) {
+            in = argv[c];
+        } else if (out == NULL) {
+            out = argv[c];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if ((in == NULL) || (out == NULL) || (bootaddr < 2 * pagesize) || (bootaddr > FLASH_MAX) ||
+        (pagesize < 32) || (pagesize & (pagesize - 1)) || (bootaddr % pagesize))
+        usage(argv[0]);
+    if (readHex(in) != 0)
+        return 1;
+    manaddr = APPMANIFEST_ADDR_EX(bootaddr, pagesize);
+
+    /* collect used pages as runs of consecutive pages */
+    for (a = 0; a < FLASH_MAX; a += pagesize) {
+        unsigned long e;
+
+        for (e = a + pagesize; e > a; e--)
+            if (used[e - 1])
+                break;
+        if (e == a)
+            continue;
+        if (a >= manaddr) {
+            fprintf(stderr, "image overlaps manifest page or bootloader at 0x%lx\n", a);
+            return 1;
+        }
+        if ((nseg > 0) && (start[nseg - 1] + ((end[nseg - 1] - start[nseg - 1] + pagesize - 1) / pagesize) * pagesize == a)) {
+            end[nseg - 1] = e;
+        } else {
+            start[nseg] = a;
+            end[nseg] = e;
+            nseg++;
+        }
+    }
+    if (nseg == 0) {
+        fprintf(stderr, "%s: no data\n", in);
+        return 1;
+    }
+    /* merge the smallest gaps until the segments fit into the manifest */
+    while (nseg > APPMANIFEST_MAXSEGMENTS) {
+        unsigned best = 0;
+        for (i = 1; i + 1 < nseg; i++)
+            if ((start[i + 1] - end[i]) < (start[best + 1] - end[best]))
+                best = i;
+        end[best] = end[best + 1];
+        memmove(start + best + 1, start + best + 2, (nseg - best - 2) * sizeof(start[0]));
+        memmove(end + best + 1, end + best + 2, (nseg - best - 2) * sizeof(end[0]));
+        nseg--;
+    }
+    /* gaps inside a segment read back as erased flash */
+    for (i = 0; i < nseg; i++) {
+        for (a = start[i]; a < end[i]; a++) {
+            crc = crc16Update(crc, used[a] ? flash[a] : 0xff);
+        }
+        length += end[i] - start[i];
+        pages  += (end[i] - start[i] + pagesize - 1) / pagesize;
+    }
+
+    memset(m, 0xff, sizeof(m));
+    put16(m + offsetof(appmanifest_t, magic), APPMANIFEST_MAGIC);
+    m[offsetof(appmanifest_t, version)]  = APPMANIFEST_VERSION;
+    m[offsetof(appmanifest_t, segments)] = nseg;
+    put32(m + offsetof(appmanifest_t, length), length);
+    put16(m + offsetof(appmanifest_t, pages), pages);
+    put16(m + offsetof(appmanifest_t, crc), crc);
+    for (i = 0; i < nseg; i++) {
+        put32(m + offsetof(appmanifest_t, segment) + i * sizeof(appmanifestsegment_t) + offsetof(appmanifestsegment_t, start), start[i]);
+        put32(m + offsetof(appmanifest_t, segment) + i * sizeof(appmanifestsegment_t) + offsetof(appmanifestsegment_t, length), end[i] - start[i]);
+    }
+    crc = 0xffff;
+    for (i = 0; i < offsetof(appmanifest_t, mancrc); i++)
+        crc = crc16Update(crc, m[i]);
+    put16(m + offsetof(appmanifest_t, mancrc), crc);
+
+    for (i = 0; i < sizeof(m); i++) {
+        flash[manaddr + i] = m[i];
+        used[manaddr + i] = 1;
+    }
+    if (writeHex(out) != 0)
+        return 1;
+
+    printf("manifest at 0x%05lx: %u segment(s), %lu bytes in %u pages, crc 0x%04x\n",
+           manaddr, nseg, (unsigned long)length, pages, m[offsetof(appmanifest_t, crc)] | (m[offsetof(appmanifest_t, crc) + 1] << 8));
+    for (i = 0; i < nseg; i++)
+        printf("  0x%05lx - 0x%05lx\n", start[i], end[i] - 1);
+    return 0;
+}
@@ -0,0 +1,140 @@
+/* Name: tracedecode.c
+ * Project: USBaspLoader
+ * Creation Date: 2026-10-18
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ */
+
+/*
+ * Host side decoder for the binary trace records produced by
+ * "firmware/usbdrv/oddebug.c" when compiled with DEBUG_TRACE enabled.
+ *
+ * Each record is: 0xa5, prefix, timestamp-low, timestamp-high, len, data[len]
+ * The timestamp is the 16-bit TCNT1 value running at F_CPU/prescaler.
+ *
+ * Usage: tracedecode [-c F_CPU] [-p prescaler] [file]
+ * Without a file the trace is read from stdin, e.g.:
+ *     stty -F /dev/ttyUSB0 19200 raw && tracedecode < /dev/ttyUSB0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define TRACE_SYNC      0xa5
+#define TRACE_DROPPED   0xfe
+
+struct eventname {
+    unsigned char   prefix;
+    const char      *name;
+};
+
+/* prefixes used by the firmware, see DBG1()/DBG2() calls */
+static const struct eventname eventnames[] = {
+    { 0x00, "bootloader start" },
+    { 0x01, "leave bootloader" },
+    { 0x10, "rx OUT/DATA" },
+    { 0x1d, "rx SETUP" },
+    { 0x20, "tx build" },
+    { 0x21, "tx ep1" },
+    { 0x22, "tx ep3" },
+    { 0x31, "setup address" },
+    { 0x32, "page fill" },
+    { 0x33, "page erase" },
+    { 0x34, "page write" },
+    { 0x35, "write chunk done" },
+    { 0x36, "erase-ahead page" },
+    { 0x37, "staged update" },
+    { TRACE_DROPPED, "*** records dropped ***" },
+    { 0xff, "usb reset" },
+};
+
+static const char *eventName(unsigned char prefix)
+{
+    unsigned i;
+
+    for (i = 0; i < sizeof(eventnames) / sizeof(eventnames[0]); i++)
+        if (eventnames[i].prefix == prefix)
+            return eventnames[i].name;
+    if ((prefix & 0xf0) == 0x10)
+        return "rx";
+    return "";
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-c F_CPU] [-p prescaler] [file]\n", argv0);
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    FILE            *in = stdin;
+    double          fcpu = 16000000.0;
+    double          prescaler = 64.0;
+    double          tickus;
+    uint64_t        now = 0, last = 0;
+    unsigned        lastts = 0;
+    int             first = 1;
+    unsigned long   skipped = 0, records = 0;
+    int             i, c;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-c") && (i + 1 < argc)) {
+            fcpu = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-p") && (i + 1 < argc)) {
+            prescaler = atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+        } else {
+            in = fopen(argv[i], "rb");
+            if (!in) {
+                perror(argv[i]);
+                return 1;
+            }
+        }
+    }
+    if ((fcpu <= 0) || (prescaler <= 0))
+        usage(argv[0]);
+    tickus = prescaler * 1000000.0 / fcpu;
+
+    printf("%12s %10s  id  %-24s data\n", "time[us]", "delta[us]", "event");
+    while ((c = fgetc(in)) != EOF) {
+        unsigned char   hdr[4], data[256];
+        unsigned        ts, len, j;
+
+        if (c != TRACE_SYNC) {
+            skipped++;
+            continue;
+        }
+        if (fread(hdr, 1, sizeof(hdr), in) != sizeof(hdr))
+            break;
+        len = hdr[3];
+        if ((len) && (fread(data, 1, len, in) != len))
+            break;
+        records++;
+
+        /* extend the 16-bit timestamp, assuming less than one wrap between records */
+        ts = hdr[1] | (hdr[2] << 8);
+        if (first) {
+            first = 0;
+        } else {
+            now += (uint16_t)(ts - lastts);
+        }
+        lastts = ts;
+
+        printf("%12.1f %10.1f  %02x  %-24s", now * tickus, (now - last) * tickus, hdr[0], eventName(hdr[0]));
+        for (j = 0; j < len; j++)
+            printf(" %02x", data[j]);
+        putchar('\n');
+        last = now;
+    }
+
+    if (skipped)
+        fprintf(stderr, "%lu bytes outside of records skipped (lost sync)\n", skipped);
+    fprintf(stderr, "%lu records decoded\n", records);
+    if (in != stdin)
+        fclose(in);
+    return 0;
+}
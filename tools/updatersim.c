@@ -0,0 +1,409 @@
+/* Name: updatersim.c
+ * Project: USBaspLoader
+ * Creation Date: 2026-10-18
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ */
+
+/*
+ * Dry run of the updater ("updater/updater.c") against an emulated flash.
+ * The three phases are replayed exactly as the updater does them:
+ *
+ *   A  copy the pages holding "bootloader__do_spm" to TEMP_SPM_PAGEADR
+ *      (through the old "bootloader__do_spm")
+ *   B  write the new bootloader up to TEMP_SPM_BLKSIZE bytes behind
+ *      NEW_SPM_ADDRESS (through the temporary copy)
+ *   C  write the rest (through the new "bootloader__do_spm")
+ *
+ * Every SPM call checks that the routine it calls is intact and that the
+ * page being erased or written does not hold that very routine. The flash
+ * model knows the page buffer and that writing can only clear bits, so a
+ * missing erase shows up as a mismatch in the final image. Per phase the
+ * erases, writes and page fills are counted and the SPM time is estimated
+ * (erase and write t_WD_FLASH 4.5ms each, fill SIMFILLCYCLES at F_CPU).
+ *
+ * Images are random (but reproducible, with runs the packer can use) unless
+ * given as raw binaries, the "bootloader__do_spm" routine is the same in both.
+ *
+ * With "-p" the new image is read from the packed stream ("tools/updpack")
+ * the way the updater built with UPDATECOMPRESS does, and the flash is then
+ * compared byte by byte with the raw new image: a packing round trip test.
+ *
+ * Usage: updatersim [-d device] [-o old.raw] [-n new.raw] [-p new.pak] [-w new.raw] [-m] [-a] [-v]
+ *   -d  only simulate this device (default: all devices of Makefile.inc)
+ *   -o  currently installed bootloader (raw binary from BOOTLOADER_ADDRESS)
+ *   -n  new bootloader (e.g. "updater/usbasploader.raw")
+ *   -p  packed new bootloader ("updpack" output of the "-n" image)
+ *   -w  write the new image used to this file (raw binary)
+ *   -m  bootloader built with HAVE_SPMINTEREFACE_MAGICVALUE
+ *   -a  updater built without CONFIG_UPDATER_REDUCEWRITES (always erase)
+ *   -v  list every page operation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef F_CPU
+#   define F_CPU        16000000UL
+#endif
+#define FLASH_MAX       (256UL * 1024UL)
+#define PAGE_MAX        256
+#define TEMP_SPM_NUMPAGE    4           /* as in "updater.c" */
+#define SIMERASEUS      4500            /* t_WD_FLASH */
+#define SIMWRITEUS      4500
+#define SIMFILLCYCLES   40              /* call, magic check, SPM, return */
+
+/* taken from "firmware/spminterface.h" and "Makefile.inc" */
+typedef struct {
+    const char  *name;
+    uint32_t    flashsize;
+    unsigned    pagesize;
+    uint32_t    bootaddr;
+    uint32_t    dospm;          /* funcaddr___bootloader__do_spm */
+    unsigned    dospmwords;     /* without magic value check */
+} device_t;
+
+static const device_t devices[] = {
+    { "atmega8535",   8192,  64, 0x01800, 0x0182a, 15 },
+    { "atmega8",      8192,  64, 0x01800, 0x01826, 15 },
+    { "atmega16",    16384, 128, 0x03800, 0x03854, 15 },
+    { "atmega32",    32768, 128, 0x07000, 0x07054, 15 },
+    { "atmega88",     8192,  64, 0x01800, 0x01834, 15 },
+    { "atmega162",   16384, 128, 0x03800, 0x03870, 15 },
+    { "atmega164p",  16384, 128, 0x03800, 0x0387c, 16 },
+    { "atmega168",   16384, 128, 0x03800, 0x03868, 15 },
+    { "atmega324p",  32768, 128, 0x07000, 0x0707c, 16 },
+    { "atmega328p",  32768, 128, 0x07000, 0x07068, 15 },
+    { "atmega640",   65536, 256, 0x0e000, 0x0e0e4, 16 },
+    { "atmega644",   65536, 256, 0x0e000, 0x0e070, 16 },
+    { "atmega644p",  65536, 256, 0x0e000, 0x0e07c, 16 },
+    { "atmega128",  131072, 256, 0x1e000, 0x1e08c, 20 },
+    { "atmega1280", 131072, 256, 0x1e000, 0x1e0e4, 16 },
+    { "atmega1281", 131072, 256, 0x1e000, 0x1e0cc, 16 },
+    { "atmega1284p",131072, 256, 0x1e000, 0x1e08c, 16 },
+    { "atmega2560", 262144, 256, 0x3e000, 0x3e0e4, 16 },
+    { "atmega2561", 262144, 256, 0x3e000, 0x3e0cc, 16 },
+};
+
+typedef struct {
+    unsigned    pages, erases, writes, skipped, fills;
+} phase_t;
+
+static uint8_t  flash[FLASH_MAX];
+static uint16_t pagebuf[PAGE_MAX / 2];
+static uint8_t  oldimg[FLASH_MAX], newimg[FLASH_MAX], packed[FLASH_MAX];
+static long     oldsize = -1, newsize = -1, packedsize = -1;
+static const char *writename;
+static int      withmagic, alwayserase, verbose;
+
+/* simulation state of the device currently run */
+static const device_t   *dev;
+static const uint8_t    *spmcode;           /* "bootloader__do_spm" as it must be found in flash */
+static unsigned         spmlen;
+static phase_t          *phase;
+static const char       *phasename;
+static unsigned         errors;
+
+static void error(const char *fmt, uint32_t a, uint32_t b)
+{
+    printf("    ERROR (%s): ", phasename);
+    printf(fmt, (unsigned long)a, (unsigned long)b);
+    printf("\n");
+    errors++;
+}
+
+/* emulated "do_spm": "via" is the flash byte address of the routine called */
+static void spm(uint32_t via, uint32_t addr, char op, uint16_t data)
+{
+    uint32_t    page = addr - (addr % dev->pagesize);
+    unsigned    i;
+
+    if (memcmp(flash + via, spmcode, spmlen) != 0) {
+        error("do_spm at 0x%05lx is not intact (called for 0x%05lx)", via, addr);
+        return;
+    }
+    if ((op != 'f') && (page < via + spmlen) && (via < page + dev->pagesize))
+        error("page 0x%05lx holds the executing do_spm at 0x%05lx", page, via);
+
+    switch (op) {
+    case 'e':
+        memset(flash + page, 0xff, dev->pagesize);
+        phase->erases++;
+        break;
+    case 'f':
+        pagebuf[(addr % dev->pagesize) / 2] &= data;
+        phase->fills++;
+        break;
+    case 'w':
+        for (i = 0; i < dev->pagesize / 2; i++) {
+            flash[page + 2 * i]     &= pagebuf[i] & 0xff;
+            flash[page + 2 * i + 1] &= pagebuf[i] >> 8;
+            pagebuf[i] = 0xffff;
+        }
+        phase->writes++;
+        break;
+    }
+}
+
+/* "mypgm_WRITEpage()" */
+static void writePage(uint32_t addr, const uint8_t *buffer, unsigned size, uint32_t via)
+{
+    uint32_t    page = addr - (addr % dev->pagesize);
+    int         changed = 0, needserase = alwayserase;
+    unsigned    i;
+
+    if (size > dev->pagesize)
+        size = dev->pagesize;
+    for (i = 0; i < (size & ~1U); i++) {
+        if (flash[page + i] != buffer[i])
+            changed = 1;
+        if (buffer[i] & ~flash[page + i])
+            needserase = 1;
+    }
+    phase->pages++;
+    if ((!changed) && (!alwayserase)) {
+        phase->skipped++;
+        if (verbose)
+            printf("    %s 0x%05lx unchanged\n", phasename, (unsigned long)page);
+        return;
+    }
+    if (verbose)
+        printf("    %s 0x%05lx %s via 0x%05lx\n", phasename, (unsigned long)page,
+               needserase ? "erase+write" : "write", (unsigned long)via);
+    if (needserase)
+        spm(via, page, 'e', 0);
+    for (i = 0; i < (size & ~1U); i += 2)
+        spm(via, page + i, 'f', buffer[i] | (buffer[i + 1] << 8));
+    spm(via, page, 'w', 0);
+}
+
+static unsigned long phaseMicros(const phase_t *p)
+{
+    return (unsigned long)p->erases * SIMERASEUS + (unsigned long)p->writes * SIMWRITEUS +
+           (unsigned long)(((uint64_t)p->fills * SIMFILLCYCLES * 1000000UL) / F_CPU);
+}
+
+static void printPhase(const char *name, const phase_t *p)
+{
+    unsigned long us = phaseMicros(p);
+
+    printf("  %-5s pages %4u  skipped %4u  erases %4u  writes %4u  fills %6u  %5lu.%lu ms\n",
+           name, p->pages, p->skipped, p->erases, p->writes, p->fills, us / 1000, (us % 1000) / 100);
+}
+
+/* random 64 byte blocks, every third one a run of 0xff and every fifth a "jmp" table */
+static void randomImage(uint8_t *img, long size, uint32_t seed)
+{
+    static const uint8_t jmp[4] = { 0x0c, 0x94, 0x34, 0x00 };
+    long i;
+
+    for (i = 0; i < size; i++) {
+        seed = seed * 1103515245UL + 12345;
+        if (((i / 64) % 3) == 2)
+            img[i] = 0xff;
+        else if (((i / 64) % 5) == 4)
+            img[i] = jmp[i % 4];
+        else
+            img[i] = seed >> 16;
+    }
+}
+
+/* the decoder of the updater built with UPDATECOMPRESS */
+#define UNPACK_SRCBYTE(i)   (packed[(i)])
+#define UNPACK_OFFSET_T     uint32_t
+#include "../updater/unpack.h"
+
+/* NEWFIRMWARE_READ() */
+static void newFirmwareRead(uint8_t *buffer, const uint8_t *newbl, uint32_t offset, uint32_t n)
+{
+    if (packedsize >= 0)
+        unpack_readat(buffer, offset, n);
+    else
+        memcpy(buffer, newbl + offset, n);
+}
+
+static int loadRaw(const char *name, uint8_t *img, long *size)
+{
+    FILE *f = fopen(name, "rb");
+
+    if (f == NULL) {
+        perror(name);
+        return -1;
+    }
+    *size = fread(img, 1, FLASH_MAX, f);
+    fclose(f);
+    return 0;
+}
+
+static int simulate(const device_t *d)
+{
+    static uint8_t  oldbl[FLASH_MAX], newbl[FLASH_MAX];
+    uint8_t         buffer[PAGE_MAX];
+    phase_t         pa, pb, pc, total;
+    uint32_t        blssize = d->flashsize - d->bootaddr;
+    uint32_t        tempblk, temppage, tempspm, newspm, i;
+    long            osize, nsize;
+    unsigned        duplicates = 0;
+
+    dev     = d;
+    errors  = 0;
+    spmlen  = 2 * (d->dospmwords + (withmagic ? 8 : 0));
+    tempblk = TEMP_SPM_NUMPAGE * d->pagesize;
+    temppage = d->flashsize - tempblk;
+    tempspm = temppage + (d->dospm % d->pagesize);
+    newspm  = d->bootaddr + (d->dospm % d->pagesize);
+
+    /* images: given ones or about 3/4 of the bootloader section */
+    osize = (oldsize >= 0) ? oldsize : (long)((blssize * 3 / 4) & ~1UL);
+    nsize = (newsize >= 0) ? newsize : (long)((blssize * 3 / 4) & ~1UL);
+    if ((osize > (long)blssize) || (nsize > (long)blssize)) {
+        printf("%s: image larger than the bootloader section\n", d->name);
+        return -1;
+    }
+    if (oldsize >= 0) memcpy(oldbl, oldimg, osize); else randomImage(oldbl, osize, 1);
+    if (newsize >= 0) memcpy(newbl, newimg, nsize); else randomImage(newbl, nsize, 2);
+    if ((oldsize < 0) && (newsize >= 0))
+        memcpy(oldbl + (d->dospm - d->bootaddr), newbl + (d->dospm - d->bootaddr), spmlen);
+    else if (newsize < 0)
+        memcpy(newbl + (d->dospm - d->bootaddr), oldbl + (d->dospm - d->bootaddr), spmlen);
+    if (memcmp(oldbl + (d->dospm - d->bootaddr), newbl + (newspm - d->bootaddr), spmlen) != 0)
+        printf("%s: note: the do_spm code differs between old and new image\n", d->name);
+
+    /* same checks as "updater.c" at compile time */
+    if (nsize <= (long)(tempblk + (newspm - d->bootaddr))) {
+        printf("%s: new image too small (updater: \"empty firmware!\")\n", d->name);
+        return -1;
+    }
+
+    memset(flash, 0xff, d->flashsize);
+    memcpy(flash + d->bootaddr, oldbl, osize);
+    memset(pagebuf, 0xff, sizeof(pagebuf));
+    memset(&pa, 0, sizeof(pa));
+    memset(&pb, 0, sizeof(pb));
+    memset(&pc, 0, sizeof(pc));
+
+    printf("%s: boot 0x%05lx, page %u, do_spm 0x%05lx (%u bytes), temp 0x%05lx, image %ld -> %ld bytes\n",
+           d->name, (unsigned long)d->bootaddr, d->pagesize, (unsigned long)d->dospm, spmlen,
+           (unsigned long)temppage, osize, nsize);
+
+    if (writename != NULL) {
+        FILE *f = fopen(writename, "wb");
+
+        if ((f == NULL) || (fwrite(newbl, 1, nsize, f) != (size_t)nsize)) {
+            perror(writename);
+            if (f != NULL)
+                fclose(f);
+            return -1;
+        }
+        fclose(f);
+    }
+
+    if (memcmp(flash + d->bootaddr, newbl, nsize) == 0) {
+        printf("  unchanged - nothing to do\n");
+        return 0;
+    }
+
+    /* A */
+    phase = &pa;
+    phasename = "A";
+    spmcode = oldbl + (d->dospm - d->bootaddr);
+    for (i = 0; i < tempblk; i += d->pagesize) {
+        uint32_t src = d->dospm + i;
+
+        memcpy(buffer, flash + (src - (src % d->pagesize)), d->pagesize);
+        writePage(temppage + i, buffer, d->pagesize, d->dospm);
+    }
+    /* B: "i" is not advanced when leaving the loop */
+    phase = &pb;
+    phasename = "B";
+    unpack_rewind();
+    for (i = 0;; i += d->pagesize) {
+        memset(buffer, 0xff, sizeof(buffer));
+        newFirmwareRead(buffer, newbl, i, ((nsize - i) > d->pagesize) ? d->pagesize : (nsize - i));
+        writePage(d->bootaddr + i, buffer, d->pagesize, tempspm);
+        if ((d->bootaddr + i) > (newspm + tempblk)) break;
+    }
+    /* C */
+    phase = &pc;
+    phasename = "C";
+    spmcode = newbl + (newspm - d->bootaddr);
+    for (; i < (uint32_t)nsize; i += d->pagesize) {
+        if ((pc.pages == 0) && (pb.pages > 0))
+            duplicates++;   /* the last page of B is processed again */
+        memset(buffer, 0xff, sizeof(buffer));
+        newFirmwareRead(buffer, newbl, i, ((nsize - i) > d->pagesize) ? d->pagesize : (nsize - i));
+        writePage(d->bootaddr + i, buffer, d->pagesize, newspm);
+    }
+
+    phasename = "result";
+    for (i = 0; i < (uint32_t)nsize; i++) {
+        if (flash[d->bootaddr + i] != newbl[i]) {
+            error("new image differs at 0x%05lx (0x%02lx)", d->bootaddr + i, flash[d->bootaddr + i]);
+            break;
+        }
+    }
+
+    memset(&total, 0, sizeof(total));
+    total.pages   = pa.pages + pb.pages + pc.pages;
+    total.skipped = pa.skipped + pb.skipped + pc.skipped;
+    total.erases  = pa.erases + pb.erases + pc.erases;
+    total.writes  = pa.writes + pb.writes + pc.writes;
+    total.fills   = pa.fills + pb.fills + pc.fills;
+    printPhase("A", &pa);
+    printPhase("B", &pb);
+    printPhase("C", &pc);
+    printPhase("total", &total);
+    if (duplicates)
+        printf("  note: page 0x%05lx is processed in B and again in C\n",
+               (unsigned long)(d->bootaddr + (pb.pages - 1) * d->pagesize));
+    printf("  %s\n", errors ? "FAILED" : "ok");
+    return errors ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char  *only = NULL;
+    unsigned    n, done = 0;
+    int         i, rval = 0;
+
+    for (i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc)) {
+            only = argv[++i];
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            if (loadRaw(argv[++i], oldimg, &oldsize) != 0)
+                return 1;
+        } else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+            if (loadRaw(argv[++i], newimg, &newsize) != 0)
+                return 1;
+        } else if ((strcmp(argv[i], "-p") == 0) && (i + 1 < argc)) {
+            if (loadRaw(argv[++i], packed, &packedsize) != 0)
+                return 1;
+        } else if ((strcmp(argv[i], "-w") == 0) && (i + 1 < argc)) {
+            writename = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0) {
+            withmagic = 1;
+        } else if (strcmp(argv[i], "-a") == 0) {
+            alwayserase = 1;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else {
+            fprintf(stderr, "usage: %s [-d device] [-o old.raw] [-n new.raw] [-p new.pak] [-w new.raw] [-m] [-a] [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (n = 0; n < sizeof(devices) / sizeof(devices[0]); n++) {
+        if ((only != NULL) && (strcmp(only, devices[n].name) != 0))
+            continue;
+        if (simulate(&devices[n]) != 0)
+            rval = 1;
+        done++;
+    }
+    if (done == 0) {
+        fprintf(stderr, "unknown device \"%s\"\n", only);
+        return 1;
+    }
+    return rval;
+}
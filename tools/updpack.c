@@ -0,0 +1,145 @@
+/* Name: updpack.c
+ * Project: USBaspLoader
+ * Creation Date: 2026-10-18
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ */
+
+/*
+ * Compresses the raw bootloader image embedded into the updater (built
+ * with "UPDATECOMPRESS"). The format is kept simple enough to be unpacked
+ * page by page without any buffer besides the page itself:
+ *
+ *   0ccccccc                     literal: c+1 bytes follow
+ *   1pppllll llllllll            repeat: copy l bytes (overlapping) from
+ *                                p+1 bytes back in the output (p+1 <= 8)
+ *
+ * Runs of 0xff padding are period 1 repeats, equal vector table entries
+ * ("jmp __bad_interrupt") are period 2 or 4 repeats.
+ *
+ * Usage: updpack in.raw out.pak
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define IMAGE_MAX       (256UL * 1024UL)
+
+#define MAX_PERIOD      8
+#define MIN_REPEAT      4
+#define MAX_REPEAT      4095
+#define MAX_LITERAL     128
+
+static uint8_t  in[IMAGE_MAX];
+static uint8_t  out[IMAGE_MAX + IMAGE_MAX / MAX_LITERAL + 1];
+
+static unsigned long flushLiterals(unsigned long o, unsigned long start, unsigned long end)
+{
+    while (start < end) {
+        unsigned long n = end - start;
+
+        if (n > MAX_LITERAL)
+            n = MAX_LITERAL;
+        out[o++] = n - 1;
+        memcpy(out + o, in + start, n);
+        o += n;
+        start += n;
+    }
+    return o;
+}
+
+/* unpacks the result again - same algorithm as in "updater.c" */
+static int verify(unsigned long packed, unsigned long size)
+{
+    unsigned long   s = 0, d = 0;
+    uint8_t         hist[MAX_PERIOD];
+
+    while (s < packed) {
+        uint8_t     c = out[s++];
+        unsigned    period = 0, count;
+
+        if (c & 0x80) {
+            period = ((c >> 4) & 7) + 1;
+            count = ((c & 0x0f) << 8) | out[s++];
+        } else {
+            count = c + 1;
+        }
+        while (count--) {
+            uint8_t b = period ? hist[(d - period) % MAX_PERIOD] : out[s++];
+
+            if ((d >= size) || (b != in[d]))
+                return -1;
+            hist[d % MAX_PERIOD] = b;
+            d++;
+        }
+    }
+    return (d == size) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    FILE            *f;
+    unsigned long   size, pos, lit, o = 0;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s in.raw out.pak\n", argv[0]);
+        return 1;
+    }
+    if ((f = fopen(argv[1], "rb")) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    size = fread(in, 1, sizeof(in), f);
+    if (!feof(f)) {
+        fprintf(stderr, "%s: image too large\n", argv[1]);
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    /* greedy: take the longest repeat of any period, else collect a literal */
+    for (pos = lit = 0; pos < size;) {
+        unsigned long   best = 0, bestperiod = 0, p;
+
+        for (p = 1; (p <= MAX_PERIOD) && (p <= pos); p++) {
+            unsigned long n = 0;
+
+            while ((pos + n < size) && (n < MAX_REPEAT) && (in[pos + n] == in[pos + n - p]))
+                n++;
+            if (n > best) {
+                best = n;
+                bestperiod = p;
+            }
+        }
+        if (best < MIN_REPEAT) {
+            pos++;
+            continue;
+        }
+        o = flushLiterals(o, lit, pos);
+        out[o++] = 0x80 | ((bestperiod - 1) << 4) | (best >> 8);
+        out[o++] = best & 0xff;
+        pos += best;
+        lit = pos;
+    }
+    o = flushLiterals(o, lit, pos);
+
+    if (verify(o, size) != 0) {
+        fprintf(stderr, "internal error: packed image does not unpack\n");
+        return 1;
+    }
+    if ((f = fopen(argv[2], "wb")) == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+    if (fwrite(out, 1, o, f) != o) {
+        perror(argv[2]);
+        fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    printf("%s: %lu -> %lu bytes (%lu%%)\n", argv[2], size, o, size ? (o * 100) / size : 0);
+    return 0;
+}
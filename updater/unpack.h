@@ -0,0 +1,92 @@
+/* Name: unpack.h
+ * Project: USBaspLoader (updater)
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ */
+
+#ifndef UNPACK_H_b74c3cf5ac134071b4584e0f0d8b65af
+#define UNPACK_H_b74c3cf5ac134071b4584e0f0d8b65af 1
+
+/*
+ * Decoder of the packed image (see "tools/updpack" for the format), used
+ * by the updater built with UPDATECOMPRESS and by "tools/updatersim", so
+ * both always unpack the same way. Define before including:
+ *   UNPACK_SRCBYTE(i)	byte "i" of the packed stream
+ *   UNPACK_OFFSET_T	type of stream and image offsets (default uint16_t)
+ *
+ * The image is unpacked strictly sequentially - each pass over the image
+ * has to start with "unpack_rewind()". Repeats reach at most 8 bytes back,
+ * so a small history ring carries them across page boundaries. Random
+ * access ("unpack_readat()") unpacks from the start again if it has to go
+ * back.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef UNPACK_SRCBYTE
+#  error "UNPACK_SRCBYTE(i) has to be defined"
+#endif
+#ifndef UNPACK_OFFSET_T
+#  define UNPACK_OFFSET_T	uint16_t
+#endif
+
+struct {
+  UNPACK_OFFSET_T	src;		// read index into the packed stream
+  uint16_t	count;		// bytes left of the current token
+  UNPACK_OFFSET_T	out;		// number of bytes unpacked so far
+  uint8_t	period;		// 0 for literals, otherwise distance of the repeat
+  uint8_t	pos;		// output position (modulo history size)
+  uint8_t	hist[8];	// the last 8 bytes unpacked
+} unpack;
+
+uint8_t unpack_srcbyte(void) {
+  return UNPACK_SRCBYTE(unpack.src++);
+}
+
+void unpack_rewind(void) {
+  unpack.src	= 0;
+  unpack.count	= 0;
+  unpack.out	= 0;
+  unpack.pos	= 0;
+}
+
+void unpack_read(uint8_t *dest, size_t n) {
+  uint8_t	b;
+
+  while (n) {
+    if (!unpack.count) {
+      b = unpack_srcbyte();
+      if (b & 0x80) {
+	unpack.period	= ((b >> 4) & 7) + 1;
+	unpack.count	= (((uint16_t)(b & 0x0f)) << 8) | unpack_srcbyte();
+	continue;
+      }
+      unpack.period	= 0;
+      unpack.count	= ((uint16_t)b) + 1;
+    }
+
+    if (unpack.period)	b = unpack.hist[(uint8_t)(unpack.pos - unpack.period) & 7];
+    else		b = unpack_srcbyte();
+
+    unpack.hist[unpack.pos & 7] = b;
+    unpack.pos++;
+    unpack.out++;
+    unpack.count--;
+
+    *dest++ = b;
+    n--;
+  }
+}
+
+// unpack "n" bytes starting at image offset "offset"
+void unpack_readat(uint8_t *dest, UNPACK_OFFSET_T offset, size_t n) {
+  uint8_t	b;
+
+  if (offset < unpack.out) unpack_rewind();
+  while (unpack.out < offset) unpack_read(&b, 1);
+  unpack_read(dest, n);
+}
+
+#endif /* UNPACK_H_b74c3cf5ac134071b4584e0f0d8b65af */
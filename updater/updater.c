@@ -271,6 +271,19 @@ size_t mypgm_WRITEpage(const mypgm_addr_t byteaddress,const void* buffer, const
 }
 #endif
 
+#ifdef UPDATECOMPRESS
+/* the new firmware is stored packed, "unpack.h" unpacks it */
+#if (FLASHEND > 65535)
+#	define	UNPACK_SRCBYTE(i)	pgm_read_byte_far(FULLCORRECTFLASHADDRESS(&packed_firmware[(i)]))
+#else
+#	define	UNPACK_SRCBYTE(i)	pgm_read_byte(FULLCORRECTFLASHADDRESS(&packed_firmware[(i)]))
+#endif
+#include "unpack.h"
+#	define	NEWFIRMWARE_READ(buffer, offset, n)	unpack_readat((buffer), (offset), (n))
+#else
+#	define	NEWFIRMWARE_READ(buffer, offset, n)	mymemcpy_PF((void*)(buffer), (uint_farptr_t)(FULLCORRECTFLASHADDRESS(&new_firmware[(offset)])), (n))
+#endif
+
 #if defined(UPDATECRC32)
 #include "crccheck.c"
 #endif
@@ -291,6 +304,14 @@ int main(void)
 #if defined(UPDATECRC32)
     // check if new firmware-image is corrupted
     crcval = D_32;
+#ifdef UPDATECOMPRESS
+    // the crc covers the unpacked image - so this checks the unpacking, too
+    unpack_rewind();
+    for (i=0;i<SIZEOF_new_firmware;i+=1) {
+      unpack_read(buffer, 1);
+      crcval = update_crc_32(crcval, buffer[0]);
+    }
+#else
     for (i=0;i<SIZEOF_new_firmware;i+=1) {
 #if (FLASHEND > 65535)
       crcval = update_crc_32(crcval, pgm_read_byte_far(FULLCORRECTFLASHADDRESS(&new_firmware[i])));
@@ -298,6 +319,7 @@ int main(void)
       crcval = update_crc_32(crcval, pgm_read_byte(FULLCORRECTFLASHADDRESS(&new_firmware[i])));
 #endif
     }
+#endif
     crcval ^= D_32;
 
     // allow to change the firmware
@@ -305,6 +327,20 @@ int main(void)
 #endif
 
     // check if firmware would change...
+#ifdef UPDATECOMPRESS
+    unpack_rewind();
+    for (i=0;i<SIZEOF_new_firmware;i+=1) {
+      uint8_t b;
+      unpack_read(&b, 1);
+#if (FLASHEND > 65535)
+      if (b!=pgm_read_byte_far(NEW_BOOTLOADER_ADDRESS+i)) break;
+#else
+      if (b!=pgm_read_byte(NEW_BOOTLOADER_ADDRESS+i)) break;
+#endif
+    }
+    buffer[0]=(i<SIZEOF_new_firmware);
+    unpack_rewind();
+#else
     buffer[0]=0;
     for (i=0;i<SIZEOF_new_firmware;i+=2) {
       uint16_t a, b;
@@ -320,6 +356,7 @@ int main(void)
 	break;
       }
     }
+#endif
 
 
 
@@ -339,7 +376,7 @@ int main(void)
 #ifdef CONFIG_UPDATER_CLEANMEMCLEAR
 	memset((void*)buffer, 0xff, sizeof(buffer));
 #endif
-	mymemcpy_PF((void*)buffer, (uint_farptr_t)(FULLCORRECTFLASHADDRESS(&new_firmware[i])), ((SIZEOF_new_firmware-i)>sizeof(buffer))?sizeof(buffer):(SIZEOF_new_firmware-i));
+	NEWFIRMWARE_READ(buffer, i, ((SIZEOF_new_firmware-i)>sizeof(buffer))?sizeof(buffer):(SIZEOF_new_firmware-i));
 	
 	mypgm_WRITEpage(NEW_BOOTLOADER_ADDRESS+i, buffer, sizeof(buffer), temp_do_spm);
 	
@@ -352,7 +389,7 @@ int main(void)
 #ifdef CONFIG_UPDATER_CLEANMEMCLEAR
 	memset((void*)buffer, 0xff, sizeof(buffer));
 #endif
-	mymemcpy_PF((void*)buffer, (uint_farptr_t)(FULLCORRECTFLASHADDRESS(&new_firmware[i])), ((SIZEOF_new_firmware-i)>sizeof(buffer))?sizeof(buffer):(SIZEOF_new_firmware-i));
+	NEWFIRMWARE_READ(buffer, i, ((SIZEOF_new_firmware-i)>sizeof(buffer))?sizeof(buffer):(SIZEOF_new_firmware-i));
 
 	mypgm_WRITEpage(NEW_BOOTLOADER_ADDRESS+i, buffer, sizeof(buffer), new_do_spm);
 	
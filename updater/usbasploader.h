@@ -17,8 +17,17 @@
 #endif
 
 
+#ifdef UPDATECOMPRESS
+  #ifndef SIZEOF_packed_firmware
+    #error unable to determine binary size of packed firmware
+  #endif
+/* "usbasploader" holds the packed image (see "tools/updpack") */
+extern const uint8_t usbasploader[SIZEOF_packed_firmware] PROGMEM;
+const uint8_t *packed_firmware	=	(void*)&usbasploader;
+#else
 extern const const uint16_t usbasploader[SIZEOF_new_firmware>>1] PROGMEM;
 const uint8_t *new_firmware	=	(void*)&usbasploader;
+#endif
 
 #endif
 